@@ -0,0 +1,61 @@
+// Benchmark of the typed getters in a tight loop, built with the library:
+//
+//     g++ -std=c++17 -O2 -I. tools/ujson_bench_getters.cpp ujson.cpp -o ujson-bench-getters
+//
+// Parses an array of mixed integers and strings, then reads each element by get_type(),
+// as_int() or as_str() and get(). The elements are fetched once before timing, so only
+// the getters are measured. Prints the best time of the runs in ns per element.
+
+#include "ujson.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+int main(int argc, char* argv[])
+{
+    const int32_t count = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+    const int32_t runs = (argc > 2) ? std::atoi(argv[2]) : 20;
+
+    std::string text = "[";
+    for (int32_t i = 0; i < count; i++) {
+        if (i) text += ',';
+        text += (i % 2) ? "\"s" + std::to_string(i % 100) + '"' : std::to_string(i);
+    }
+    text += ']';
+
+    try {
+        ujson::Json json;
+        const ujson::Arr& arr = json.parse(text.c_str(), text.size()).as_arr();
+        std::vector<const ujson::Val*> elements(arr.get_len());
+        for (int32_t i = 0; i < arr.get_len(); i++) {
+            elements[i] = &arr.get_element(i);
+        }
+
+        double best = 1e9;
+        int64_t sum = 0;
+        for (int32_t run = 0; run < runs; run++) {
+            const auto start = std::chrono::steady_clock::now();
+            for (const ujson::Val* v : elements) {
+                if (ujson::vtInt == v->get_type()) {
+                    sum += v->as_int().get();
+                }
+                else {
+                    sum += v->as_str().get()[1];
+                }
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        std::printf("%d elements, best of %d runs: %.2f ns/element (checksum %lld)\n",
+            count, runs, best * 1e9 / count, static_cast<long long>(sum));
+    }
+    catch (const ujson::Err& e) {
+        std::fprintf(stderr, "%s", e.get_err_str().c_str());
+        return 1;
+    }
+    return 0;
+}
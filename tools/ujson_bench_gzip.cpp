@@ -0,0 +1,123 @@
+// Benchmark of GzipReader and Json::parse_ndjson() against inflating the whole file first,
+// built with the library and zlib:
+//
+//     g++ -std=c++17 -O2 -pthread -DUJSON_ZLIB -I. tools/ujson_bench_gzip.cpp ujson.cpp -lz -o ujson-bench-gzip
+//     ujson-bench-gzip generate events.ndjson.gz [lines]
+//     ujson-bench-gzip inflate events.ndjson.gz
+//     ujson-bench-gzip stream events.ndjson.gz
+//
+// 'generate' writes a gzipped NDJSON file of event records (default: 200k lines, 19 MB).
+// 'inflate' decompresses the whole file into memory, then parses its lines. 'stream' parses
+// the lines while GzipReader decompresses the file. Each mode runs in its own process, so the
+// maximum RSS printed is its own.
+
+#include "ujson.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <zlib.h>
+#if !defined(_WIN32)
+#  include <sys/resource.h>
+#endif
+
+static void generate(const char* path, int32_t lines)
+{
+    gzFile file = gzopen(path, "wb");
+    if (nullptr == file) {
+        throw ujson::Err("can't create file", 0);
+    }
+    static const char* const events[] = { "click", "view", "purchase", "login", "logout" };
+    char line[256];
+    for (int32_t i = 0; i < lines; i++) {
+        const int len = snprintf(line, sizeof(line),
+            "{\"id\":%d,\"user\":\"user%d\",\"event\":\"%s\",\"ts\":%d.%03d,\"tags\":[\"a\",\"b\"],\"ok\":%s}\n",
+            i, i % 10007, events[i % 5], 1700000000 + i, i % 1000, (i % 3) ? "true" : "false");
+        gzwrite(file, line, static_cast<unsigned>(len));
+    }
+    gzclose(file);
+}
+
+static std::string inflate_file(const char* path)
+{
+    gzFile file = gzopen(path, "rb");
+    if (nullptr == file) {
+        throw ujson::Err("can't open file", 0);
+    }
+    std::string text;
+    char buf[1 << 16];
+    int n;
+    while ((n = gzread(file, buf, sizeof(buf))) > 0) {
+        text.append(buf, static_cast<size_t>(n));
+    }
+    gzclose(file);
+    if (n < 0) {
+        throw ujson::Err("can't decompress file", 0);
+    }
+    return text;
+}
+
+static double max_rss_mb()
+{
+#if defined(_WIN32)
+    return 0.0;
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#  if defined(__APPLE__)
+    return usage.ru_maxrss / 1e6; // bytes
+#  else
+    return usage.ru_maxrss / 1e3; // KB
+#  endif
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: ujson-bench-gzip (generate <file> [lines] | inflate <file> | stream <file>)\n");
+        return 2;
+    }
+    const std::string mode = argv[1];
+    const char* path = argv[2];
+    try {
+        if ("generate" == mode) {
+            generate(path, (argc > 3) ? std::atoi(argv[3]) : 200000);
+            return 0;
+        }
+        ujson::Json json;
+        int64_t sum = 0;
+        size_t lines = 0;
+        auto count = [&](const ujson::Val& root) {
+            sum += root.as_obj().get_i64("id");
+        };
+        const auto start = std::chrono::steady_clock::now();
+        if ("inflate" == mode) {
+            const std::string text = inflate_file(path);
+            size_t pos = 0;
+            lines = json.parse_ndjson([&](char* buf, size_t size) {
+                const size_t n = std::min(size, text.size() - pos);
+                std::memcpy(buf, text.data() + pos, n);
+                pos += n;
+                return n;
+            }, count);
+        }
+        else if ("stream" == mode) {
+            lines = json.parse_ndjson(ujson::GzipReader(path), count);
+        }
+        else {
+            std::fprintf(stderr, "unknown mode %s\n", mode.c_str());
+            return 2;
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::printf("%s: %zu lines, %.0f ms, max RSS %.0f MB (checksum %lld)\n",
+            mode.c_str(), lines, elapsed.count() * 1e3, max_rss_mb(), static_cast<long long>(sum));
+    }
+    catch (const ujson::Err& e) {
+        std::fprintf(stderr, "%s", e.get_err_str().c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Scaling benchmark of Json::set_threads(), built with the library:
+//
+//     g++ -std=c++17 -O2 -pthread -I. tools/ujson_bench_parallel.cpp ujson.cpp -o ujson-bench-parallel
+//     ujson-bench-parallel [file] [max_threads] [runs]
+//
+// Parses the file, or a generated array of 1M records, by 1, 2, 4 ... max_threads threads
+// (default: the number of cores). Prints the best time of the runs and the speedup over one thread.
+
+#include "ujson.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+static std::string generate(int32_t count)
+{
+    std::string text = "[\n";
+    for (int32_t i = 0; i < count; i++) {
+        const std::string n = std::to_string(i);
+        text += "  {\"id\": " + n + ", \"name\": \"user" + n + "\", \"score\": " + n + ".5, "
+            "\"active\": " + ((i % 3) ? "true" : "false") + ", \"tags\": [\"a\", \"b\", " + n + "]}";
+        text += (i + 1 < count) ? ",\n" : "\n";
+    }
+    text += "]\n";
+    return text;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string text;
+    if (argc > 1 && 0 != strcmp(argv[1], "-")) {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (!file) {
+            std::fprintf(stderr, "can't open %s\n", argv[1]);
+            return 1;
+        }
+        std::ostringstream buf;
+        buf << file.rdbuf();
+        text = buf.str();
+    }
+    else {
+        text = generate(1000000);
+    }
+    const int32_t max_threads = (argc > 2) ? std::atoi(argv[2]) : std::max(1, static_cast<int32_t>(std::thread::hardware_concurrency()));
+    const int32_t runs = (argc > 3) ? std::atoi(argv[3]) : 5;
+
+    std::printf("%.1f MB, %u cores\n", text.size() / 1e6, std::thread::hardware_concurrency());
+    double base = 0.0;
+    try {
+        for (int32_t threads = 1; threads <= max_threads; threads *= 2) {
+            double best = 1e9;
+            for (int32_t run = 0; run < runs; run++) {
+                ujson::Json json;
+                json.set_threads(threads);
+                const auto start = std::chrono::steady_clock::now();
+                json.parse(text.c_str(), text.size());
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+            }
+            if (1 == threads) base = best;
+            std::printf("%3d threads: %8.1f ms  %6.0f MB/s  speedup %.2f\n",
+                threads, best * 1e3, text.size() / best / 1e6, base / best);
+        }
+    }
+    catch (const ujson::Err& e) {
+        std::fprintf(stderr, "%s", e.get_err_str().c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,569 @@
+// Generates C++ structs and their decoders from a schema (see Schema in README.md) or from sample
+// documents, built with the library:
+//
+//     g++ -std=c++17 -O2 -I. tools/ujson_codegen.cpp ujson.cpp -o ujson-codegen
+//     ujson-codegen --name Config --schema config.schema.json > config_json.h
+//     ujson-codegen --name Event sample1.json sample2.json > event_json.h
+//
+// The decoders iterate the members once, dispatching the names by their length and then by comparing
+// them to constants, and fetch the values with the getters of ujson, so the values are checked and
+// the errors are thrown as by the getters and by Schema.
+
+#include "ujson.h"
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <set>
+#include <algorithm>
+
+namespace {
+
+enum Kind { kAny, kBool, kInt, kF64, kStr, kArr, kObj };
+
+struct Type;
+
+struct Member
+{
+    std::string           name;
+    std::unique_ptr<Type> type;
+    bool                  required = true;
+    size_t                seen = 0;     // number of objects containing it, for the samples
+    std::string           field;        // C++ identifier, unique in the struct
+};
+
+struct Type
+{
+    Kind                     kind = kAny;
+    uint32_t                 seen_types = 0; // ValType bits, for the samples
+    size_t                   seen_objs = 0;
+    bool                     has_range = false;
+    double                   min = 0.0;
+    double                   max = 0.0;
+    bool                     has_len = false;
+    int32_t                  min_len = 0;
+    int32_t                  max_len = INT32_MAX;
+    std::vector<std::string> enum_values;
+    std::unique_ptr<Type>    item;
+    std::vector<Member>      members;
+    bool                     additional = true;
+    std::string              struct_name;
+
+    Member* find(const char* name)
+    {
+        for (auto& m : members) {
+            if (m.name == name) return &m;
+        }
+        return nullptr;
+    }
+};
+
+std::string read_text(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (nullptr == file) {
+        throw ujson::Err("can't open file", 0);
+    }
+    std::string text;
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        text.append(buf, n);
+    }
+    fclose(file);
+    return text;
+}
+
+// Schema
+
+Kind kind_from_name(const ujson::Str& name)
+{
+    static const std::array<const char*, 8> names = { "null", "bool", "int", "float", "str", "arr", "obj", "any" };
+    static const std::array<Kind, 8> kinds = { kAny, kBool, kInt, kF64, kStr, kArr, kObj, kAny };
+    return name.get_enum(names, kinds);
+}
+
+std::unique_ptr<Type> type_from_schema(const ujson::Obj& schema)
+{
+    auto type = std::make_unique<Type>();
+    if (const ujson::Val* v = schema.get_member("type", false)) {
+        type->kind = (ujson::vtStr == v->get_type()) ? kind_from_name(v->as_str()) : kAny;
+    }
+    const ujson::Val* min = schema.get_member("min", false);
+    const ujson::Val* max = schema.get_member("max", false);
+    if (min || max) {
+        type->has_range = true;
+        type->min = min ? min->as_f64().get() : -1e308;
+        type->max = max ? max->as_f64().get() : 1e308;
+    }
+    const ujson::Val* min_len = schema.get_member("min_len", false);
+    const ujson::Val* max_len = schema.get_member("max_len", false);
+    if (min_len || max_len) {
+        type->has_len = true;
+        type->min_len = min_len ? min_len->as_int().get_i32() : 0;
+        type->max_len = max_len ? max_len->as_int().get_i32() : INT32_MAX;
+    }
+    if (const ujson::Val* values = schema.get_member("enum", false)) {
+        for (const ujson::Val& v : values->as_arr().get_elements()) {
+            type->enum_values.push_back(v.as_str().get());
+        }
+    }
+    if (const ujson::Val* items = schema.get_member("items", false)) {
+        type->item = type_from_schema(items->as_obj());
+    }
+    else if (kArr == type->kind) {
+        type->item = std::make_unique<Type>();
+    }
+    if (const ujson::Val* members = schema.get_member("members", false)) {
+        for (const auto m : members->as_obj().get_members()) {
+            Member member;
+            member.name = m.name;
+            member.type = type_from_schema(m.val.as_obj());
+            member.required = m.val.as_obj().get_bool("required", true);
+            type->members.push_back(std::move(member));
+        }
+    }
+    type->additional = schema.get_bool("additional", true);
+    schema.ignore_members();
+    return type;
+}
+
+// Samples
+
+void add_sample(Type& type, const ujson::Val& v)
+{
+    type.seen_types |= v.get_type();
+    if (ujson::vtArr == v.get_type()) {
+        if (!type.item) type.item = std::make_unique<Type>();
+        for (const ujson::Val& e : v.as_arr().get_elements()) {
+            add_sample(*type.item, e);
+        }
+    }
+    else if (ujson::vtObj == v.get_type()) {
+        type.seen_objs++;
+        for (const auto m : v.as_obj().get_members()) {
+            Member* member = type.find(m.name);
+            if (nullptr == member) {
+                type.members.emplace_back();
+                member = &type.members.back();
+                member->name = m.name;
+                member->type = std::make_unique<Type>();
+            }
+            member->seen++;
+            add_sample(*member->type, m.val);
+        }
+    }
+}
+
+// Sets the kinds from the types seen. A member is optional if it is absent from an object or null.
+void resolve_samples(Type& type)
+{
+    const uint32_t types = type.seen_types & ~ujson::vtNull;
+    switch (types) {
+    case ujson::vtBool:                 type.kind = kBool; break;
+    case ujson::vtInt:                  type.kind = kInt; break;
+    case ujson::vtF64:
+    case ujson::vtInt | ujson::vtF64:   type.kind = kF64; break;
+    case ujson::vtStr:                  type.kind = kStr; break;
+    case ujson::vtArr:                  type.kind = kArr; break;
+    case ujson::vtObj:                  type.kind = kObj; break;
+    default:                            type.kind = kAny; break;
+    }
+    if (kArr == type.kind) {
+        resolve_samples(*type.item);
+    }
+    if (kObj == type.kind) {
+        for (auto& m : type.members) {
+            m.required = (m.seen == type.seen_objs) && 0 == (m.type->seen_types & ujson::vtNull);
+            resolve_samples(*m.type);
+        }
+    }
+}
+
+// Output
+
+bool is_keyword(const std::string& id)
+{
+    static const char* const keywords[] = {
+        "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class", "const",
+        "constexpr", "continue", "decltype", "default", "delete", "do", "double", "else", "enum", "explicit",
+        "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+        "namespace", "new", "noexcept", "not", "nullptr", "operator", "or", "private", "protected", "public",
+        "register", "return", "short", "signed", "sizeof", "static", "struct", "switch", "template", "this",
+        "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual",
+        "void", "volatile", "while", "xor" };
+    for (const char* k : keywords) {
+        if (id == k) return true;
+    }
+    return false;
+}
+
+std::string field_name(const std::string& name)
+{
+    std::string id;
+    for (char c : name) {
+        id += (isalnum(static_cast<unsigned char>(c)) || '_' == c) ? c : '_';
+    }
+    if (id.empty() || isdigit(static_cast<unsigned char>(id[0])) || is_keyword(id)) {
+        id = "_" + id;
+    }
+    return id;
+}
+
+std::string type_name(const std::string& name) // CamelCase
+{
+    std::string id;
+    bool upper = true;
+    for (char c : name) {
+        if (isalnum(static_cast<unsigned char>(c))) {
+            id += upper ? static_cast<char>(toupper(static_cast<unsigned char>(c))) : c;
+            upper = false;
+        }
+        else {
+            upper = true;
+        }
+    }
+    return id;
+}
+
+std::string c_str_literal(const std::string& str)
+{
+    std::string out = "\"";
+    for (char c : str) {
+        const unsigned char u = static_cast<unsigned char>(c);
+        if ('"' == c || '\\' == c) {
+            out += '\\';
+            out += c;
+        }
+        else if (u < ' ' || u >= 0x7F) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", u);
+            out += buf;
+        }
+        else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+bool has_any(const Type& type) // the values are then pointers into the Json instance
+{
+    if (kAny == type.kind) return true;
+    if (kArr == type.kind) return has_any(*type.item);
+    for (const auto& m : type.members) {
+        if (has_any(*m.type)) return true;
+    }
+    return false;
+}
+
+bool fits_i32(const Type& type)
+{
+    return type.has_range && type.min >= INT32_MIN && type.max <= INT32_MAX;
+}
+
+std::string cpp_type(const Type& type)
+{
+    switch (type.kind) {
+    case kBool: return "bool";
+    case kInt:  return fits_i32(type) ? "int32_t" : "int64_t";
+    case kF64:  return "double";
+    case kStr:  return "std::string";
+    case kArr:  return "std::vector<" + cpp_type(*type.item) + ">";
+    case kObj:  return type.struct_name;
+    default:    return "const ujson::Val*"; // valid while the Json instance is
+    }
+}
+
+std::string unique_name(const std::string& name, std::set<std::string>& used) // name, name_2, name_3 ...
+{
+    std::string id = name;
+    for (int32_t i = 2; !used.insert(id).second; i++) {
+        id = name + "_" + std::to_string(i);
+    }
+    return id;
+}
+
+void name_structs(Type& type, const std::string& name, std::vector<Type*>& structs, std::set<std::string>& used)
+{
+    if (kArr == type.kind) {
+        name_structs(*type.item, name, structs, used);
+    }
+    if (kObj == type.kind) {
+        type.struct_name = unique_name(name, used);
+        for (auto& m : type.members) {
+            name_structs(*m.type, type.struct_name + type_name(m.name), structs, used);
+        }
+        structs.push_back(&type); // after the nested ones
+    }
+}
+
+std::string indent(int32_t level)
+{
+    return std::string(4 * level, ' ');
+}
+
+std::string num(double d)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", d);
+    return buf;
+}
+
+std::string int_num(double d)
+{
+    if (d <= static_cast<double>(INT64_MIN)) return "INT64_MIN";
+    if (d >= static_cast<double>(INT64_MAX)) return "INT64_MAX";
+    return std::to_string(static_cast<long long>(d)) + ((d >= INT32_MIN && d <= INT32_MAX) ? "" : "LL");
+}
+
+// Emits the statements storing the value 'val' into 'out'.
+void emit_value(FILE* f, const Type& type, const std::string& val, const std::string& out, int32_t level)
+{
+    const std::string in = indent(level);
+    switch (type.kind) {
+    case kBool:
+        fprintf(f, "%s%s = %s.as_bool().get();\n", in.c_str(), out.c_str(), val.c_str());
+        break;
+    case kInt:
+        if (fits_i32(type)) {
+            fprintf(f, "%s%s = %s.as_int().get_i32(%s, %s);\n", in.c_str(), out.c_str(), val.c_str(),
+                int_num(type.min).c_str(), int_num(type.max).c_str());
+        }
+        else if (type.has_range) {
+            fprintf(f, "%s%s = %s.as_int().get(%s, %s);\n", in.c_str(), out.c_str(), val.c_str(),
+                int_num(type.min).c_str(), int_num(type.max).c_str());
+        }
+        else {
+            fprintf(f, "%s%s = %s.as_int().get();\n", in.c_str(), out.c_str(), val.c_str());
+        }
+        break;
+    case kF64:
+        if (type.has_range) {
+            fprintf(f, "%s%s = %s.as_f64().get(%s, %s);\n", in.c_str(), out.c_str(), val.c_str(),
+                num(type.min).c_str(), num(type.max).c_str());
+        }
+        else {
+            fprintf(f, "%s%s = %s.as_f64().get();\n", in.c_str(), out.c_str(), val.c_str());
+        }
+        break;
+    case kStr:
+        if (!type.enum_values.empty()) {
+            fprintf(f, "%s{\n", in.c_str());
+            fprintf(f, "%s    static const char* const values[] = {", in.c_str());
+            for (size_t i = 0; i < type.enum_values.size(); i++) {
+                fprintf(f, "%s%s", i ? ", " : " ", c_str_literal(type.enum_values[i]).c_str());
+            }
+            fprintf(f, " };\n");
+            fprintf(f, "%s    %s.as_str().get_enum_idx(values, %zu);\n", in.c_str(), val.c_str(), type.enum_values.size());
+            fprintf(f, "%s}\n", in.c_str());
+        }
+        fprintf(f, "%s%s = %s.as_str().get();\n", in.c_str(), out.c_str(), val.c_str());
+        break;
+    case kArr: {
+        const std::string arr = "arr" + std::to_string(level);
+        const std::string e = "e" + std::to_string(level);
+        fprintf(f, "%sconst ujson::Arr& %s = %s.as_arr();\n", in.c_str(), arr.c_str(), val.c_str());
+        if (type.has_len) {
+            const std::string len = arr + ".get_len()";
+            const std::string lo = (type.min_len > 0) ? len + " < " + std::to_string(type.min_len) : "";
+            const std::string hi = (type.max_len < INT32_MAX) ? len + " > " + std::to_string(type.max_len) : "";
+            fprintf(f, "%sif (%s%s%s) {\n", in.c_str(), lo.c_str(), (lo.empty() || hi.empty()) ? "" : " || ", hi.c_str());
+            fprintf(f, "%s    throw ujson::ErrBadLen(%s, %d, %d);\n", in.c_str(), arr.c_str(), type.min_len, type.max_len);
+            fprintf(f, "%s}\n", in.c_str());
+        }
+        fprintf(f, "%s%s.clear();\n", in.c_str(), out.c_str());
+        fprintf(f, "%s%s.reserve(%s.get_len());\n", in.c_str(), out.c_str(), arr.c_str());
+        fprintf(f, "%sfor (const ujson::Val& %s : %s.get_elements()) {\n", in.c_str(), e.c_str(), arr.c_str());
+        fprintf(f, "%s    %s.emplace_back();\n", in.c_str(), out.c_str());
+        emit_value(f, *type.item, e, out + ".back()", level + 1);
+        fprintf(f, "%s}\n", in.c_str());
+        break;
+    }
+    case kObj:
+        fprintf(f, "%sdecode(%s, %s);\n", in.c_str(), val.c_str(), out.c_str());
+        break;
+    default:
+        fprintf(f, "%s%s = &%s;\n", in.c_str(), out.c_str(), val.c_str());
+        break;
+    }
+}
+
+void emit_struct(FILE* f, const Type& type)
+{
+    fprintf(f, "struct %s\n{\n", type.struct_name.c_str());
+    for (const auto& m : type.members) {
+        const std::string t = cpp_type(*m.type);
+        if (!m.required && kAny != m.type->kind) {
+            fprintf(f, "    std::optional<%s> %s;\n", t.c_str(), m.field.c_str());
+        }
+        else if (kAny == m.type->kind) {
+            fprintf(f, "    %s %s = nullptr;\n", t.c_str(), m.field.c_str());
+        }
+        else {
+            fprintf(f, "    %s %s%s;\n", t.c_str(), m.field.c_str(),
+                (kInt == m.type->kind || kF64 == m.type->kind || kBool == m.type->kind) ? "{}" : "");
+        }
+    }
+    fprintf(f, "};\n\n");
+}
+
+void emit_decoder(FILE* f, const Type& type)
+{
+    fprintf(f, "inline void decode(const ujson::Val& v, %s& out)\n{\n", type.struct_name.c_str());
+    fprintf(f, "    const ujson::Obj& obj = v.as_obj();\n");
+    if (type.members.empty()) {
+        if (!type.additional) {
+            fprintf(f, "    for (const auto m : obj.get_members()) {\n");
+            fprintf(f, "        throw ujson::ErrUnknownMember(m.val);\n");
+            fprintf(f, "    }\n");
+        }
+        fprintf(f, "    (void)out;\n}\n\n");
+        return;
+    }
+    fprintf(f, "    bool found[%zu] = {};\n", type.members.size());
+    fprintf(f, "    for (const auto m : obj.get_members()) {\n");
+    fprintf(f, "        const char* name = m.name;\n");
+    fprintf(f, "        switch (strlen(name)) {\n");
+    std::map<size_t, std::vector<size_t>> by_len;
+    for (size_t i = 0; i < type.members.size(); i++) {
+        by_len[type.members[i].name.size()].push_back(i);
+    }
+    for (const auto& [len, idxs] : by_len) {
+        fprintf(f, "        case %zu:\n", len);
+        for (size_t i : idxs) {
+            const Member& m = type.members[i];
+            const std::string field = "out." + m.field;
+            fprintf(f, "            if (0 == memcmp(name, %s, %zu)) {\n", c_str_literal(m.name).c_str(), len);
+            const bool optional = !m.required && kAny != m.type->kind;
+            int32_t level = 4;
+            if (!m.required) {
+                fprintf(f, "                if (ujson::vtNull != m.val.get_type()) {\n");
+                level = 5;
+            }
+            if (optional) {
+                fprintf(f, "%s%s.emplace();\n", indent(level).c_str(), field.c_str());
+            }
+            emit_value(f, *m.type, "m.val", optional ? "(*" + field + ")" : field, level);
+            if (!m.required) {
+                fprintf(f, "                }\n");
+            }
+            fprintf(f, "                found[%zu] = true;\n", i);
+            fprintf(f, "                continue;\n");
+            fprintf(f, "            }\n");
+        }
+        fprintf(f, "            break;\n");
+    }
+    fprintf(f, "        }\n");
+    if (!type.additional) {
+        fprintf(f, "        throw ujson::ErrUnknownMember(m.val);\n");
+    }
+    fprintf(f, "    }\n");
+    for (size_t i = 0; i < type.members.size(); i++) {
+        if (type.members[i].required) {
+            fprintf(f, "    if (!found[%zu]) throw ujson::ErrMemberNotFound(obj, %s);\n", i, c_str_literal(type.members[i].name).c_str());
+        }
+    }
+    fprintf(f, "}\n\n");
+}
+
+int usage()
+{
+    fprintf(stderr,
+        "usage: ujson-codegen --name <type> [--namespace <ns>] (--schema <file> | <sample file>...)\n"
+        "  prints a header with the structs and their decode() functions\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string name;
+    std::string ns;
+    std::string schema_path;
+    std::vector<std::string> samples;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (("--name" == arg || "--namespace" == arg || "--schema" == arg) && i + 1 < argc) {
+            ("--name" == arg ? name : "--namespace" == arg ? ns : schema_path) = argv[++i];
+        }
+        else if (arg.size() > 0 && '-' != arg[0]) {
+            samples.push_back(arg);
+        }
+        else {
+            return usage();
+        }
+    }
+    if (name.empty() || (schema_path.empty() == samples.empty())) {
+        return usage();
+    }
+
+    const char* path = "";
+    try {
+        std::unique_ptr<Type> root;
+        if (!schema_path.empty()) {
+            path = schema_path.c_str();
+            ujson::Json json;
+            const std::string text = read_text(path);
+            root = type_from_schema(json.parse(text.c_str(), text.size()).as_obj());
+        }
+        else {
+            root = std::make_unique<Type>();
+            for (const auto& sample : samples) {
+                path = sample.c_str();
+                ujson::Json json;
+                const std::string text = read_text(path);
+                add_sample(*root, json.parse(text.c_str(), text.size()));
+            }
+            resolve_samples(*root);
+        }
+        if (kObj != root->kind) {
+            throw ujson::Err("the root must be an object", 0);
+        }
+        std::vector<Type*> structs;
+        std::set<std::string> struct_names;
+        name_structs(*root, type_name(name), structs, struct_names);
+        for (Type* t : structs) {
+            std::set<std::string> fields = struct_names; // a field can't be named as a struct it uses
+            for (auto& m : t->members) {
+                m.field = unique_name(field_name(m.name), fields); // "a-b" and "a_b" are both a_b
+            }
+        }
+
+        FILE* f = stdout;
+        fprintf(f, "// Generated by ujson-codegen from %s, do not edit.\n\n", schema_path.empty() ? "samples" : "a schema");
+        fprintf(f, "#pragma once\n\n#include \"ujson.h\"\n#include <cstring>\n#include <string>\n#include <vector>\n#include <optional>\n\n");
+        if (!ns.empty()) {
+            fprintf(f, "namespace %s {\n\n", ns.c_str());
+        }
+        for (const Type* t : structs) {
+            emit_struct(f, *t);
+        }
+        for (const Type* t : structs) {
+            fprintf(f, "inline void decode(const ujson::Val& v, %s& out);\n", t->struct_name.c_str());
+        }
+        fprintf(f, "\n");
+        for (const Type* t : structs) {
+            emit_decoder(f, *t);
+        }
+        if (!has_any(*root)) {
+            fprintf(f, "inline void parse(const char* str, size_t len, %s& out)\n{\n", root->struct_name.c_str());
+            fprintf(f, "    ujson::Json json;\n");
+            fprintf(f, "    decode(json.parse(str, len), out);\n");
+            fprintf(f, "}\n");
+        }
+        if (!ns.empty()) {
+            fprintf(f, "\n} // namespace %s\n", ns.c_str());
+        }
+        return 0;
+    }
+    catch (const ujson::Err& e) {
+        fprintf(stderr, "%s%s", path, e.get_err_str().c_str());
+        return 1;
+    }
+}
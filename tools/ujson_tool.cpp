@@ -0,0 +1,427 @@
+// Command line tool for large JSON and NDJSON files, built with the library:
+//
+//     g++ -std=c++17 -O2 -pthread -I. tools/ujson_tool.cpp ujson.cpp -o ujson
+//
+// The input is mapped in memory. The throughput is printed to stderr.
+
+#include "ujson.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#if defined(_WIN32)
+#  include <memory>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+
+class Input // the content of a file, mapped in memory when possible
+{
+public:
+    explicit Input(const char* path)
+    {
+#if defined(_WIN32)
+        FILE* file = fopen(path, "rb");
+        if (nullptr == file) {
+            throw ujson::Err("can't open file", 0);
+        }
+        fseek(file, 0, SEEK_END);
+        m_len = static_cast<size_t>(ftell(file));
+        fseek(file, 0, SEEK_SET);
+        m_buf.reset(new char[m_len + 1]);
+        const size_t n = fread(m_buf.get(), 1, m_len, file);
+        fclose(file);
+        if (n != m_len) {
+            throw ujson::Err("can't read file", 0);
+        }
+        m_data = m_buf.get();
+#else
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            throw ujson::Err("can't open file", 0);
+        }
+        struct stat st;
+        if (0 != fstat(fd, &st)) {
+            close(fd);
+            throw ujson::Err("can't read file", 0);
+        }
+        m_len = static_cast<size_t>(st.st_size);
+        if (m_len > 0) {
+            void* p = mmap(nullptr, m_len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED == p) {
+                close(fd);
+                throw ujson::Err("can't map file", 0);
+            }
+            madvise(p, m_len, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(p);
+        }
+        close(fd);
+#endif
+    }
+
+    ~Input()
+    {
+#if !defined(_WIN32)
+        if (m_len > 0) {
+            munmap(const_cast<char*>(m_data), m_len);
+        }
+#endif
+    }
+
+    Input(const Input&) = delete;
+    Input& operator = (const Input&) = delete;
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_len; }
+private:
+    const char* m_data = "";
+    size_t      m_len = 0;
+#if defined(_WIN32)
+    std::unique_ptr<char[]> m_buf;
+#endif
+};
+
+class Timer // prints the throughput when destroyed
+{
+public:
+    Timer(const char* cmd, size_t bytes) : m_cmd{ cmd }, m_bytes{ bytes }, m_start{ std::chrono::steady_clock::now() } {}
+    ~Timer()
+    {
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        fprintf(stderr, "%s: %.1f MB in %.1f ms, %.1f MB/s\n",
+            m_cmd, m_bytes / 1e6, sec * 1e3, (sec > 0.0) ? m_bytes / sec / 1e6 : 0.0);
+    }
+private:
+    const char* m_cmd;
+    size_t      m_bytes;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+int32_t get_threads()
+{
+    return std::max(static_cast<int32_t>(std::thread::hardware_concurrency()), 1);
+}
+
+void write_str(FILE* out, const char* str)
+{
+    fputc('"', out);
+    for (const char* p = str; *p; p++) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        switch (c) {
+        case '"':  fputs("\\\"", out); break;
+        case '\\': fputs("\\\\", out); break;
+        case '\b': fputs("\\b", out); break;
+        case '\f': fputs("\\f", out); break;
+        case '\n': fputs("\\n", out); break;
+        case '\r': fputs("\\r", out); break;
+        case '\t': fputs("\\t", out); break;
+        default:
+            if (c < 0x20) {
+                fprintf(out, "\\u%04x", c);
+            }
+            else {
+                fputc(c, out);
+            }
+        }
+    }
+    fputc('"', out);
+}
+
+void write_val(FILE* out, const ujson::Val& v)
+{
+    switch (v.get_type()) {
+    case ujson::vtBool:
+        fputs(v.as_bool().get() ? "true" : "false", out);
+        break;
+    case ujson::vtInt:
+        fprintf(out, "%lld", static_cast<long long>(v.as_int().get()));
+        break;
+    case ujson::vtF64:
+        fprintf(out, "%.17g", v.as_f64().get());
+        break;
+    case ujson::vtStr:
+        write_str(out, v.as_str().get());
+        break;
+    case ujson::vtArr: {
+        const char* sep = "";
+        fputc('[', out);
+        for (const ujson::Val& e : v.as_arr().get_elements()) {
+            fputs(sep, out);
+            write_val(out, e);
+            sep = ",";
+        }
+        fputc(']', out);
+        break;
+    }
+    case ujson::vtObj: {
+        const char* sep = "";
+        fputc('{', out);
+        for (const auto m : v.as_obj().get_members()) {
+            fputs(sep, out);
+            write_str(out, m.name);
+            fputc(':', out);
+            write_val(out, m.val);
+            sep = ",";
+        }
+        fputc('}', out);
+        break;
+    }
+    default:
+        fputs("null", out);
+    }
+}
+
+// RFC 6901 JSON pointer, like "/servers/3/tls/port", returns nullptr if not found.
+const ujson::Val* find_pointer(const ujson::Val& root, const char* pointer)
+{
+    if (0 != *pointer && '/' != *pointer) {
+        throw ujson::Err("JSON pointer must start with '/'", 0);
+    }
+    const ujson::Val* v = &root;
+    std::string token;
+    for (const char* p = pointer; *p; ) {
+        token.clear();
+        for (p++; *p && '/' != *p; p++) {
+            if ('~' == p[0] && '0' == p[1]) {
+                token += '~';
+                p++;
+            }
+            else if ('~' == p[0] && '1' == p[1]) {
+                token += '/';
+                p++;
+            }
+            else {
+                token += *p;
+            }
+        }
+        if (ujson::vtObj == v->get_type()) {
+            v = v->as_obj().get_member(token.c_str(), false);
+        }
+        else if (ujson::vtArr == v->get_type()) {
+            char* end = nullptr;
+            const long idx = strtol(token.c_str(), &end, 10);
+            const ujson::Arr& arr = v->as_arr();
+            if (token.empty() || 0 != *end || idx < 0 || idx >= arr.get_len()) {
+                return nullptr;
+            }
+            v = &arr.get_element(static_cast<int32_t>(idx));
+        }
+        else {
+            return nullptr;
+        }
+        if (nullptr == v) {
+            return nullptr;
+        }
+    }
+    return v;
+}
+
+struct Stats
+{
+    size_t  counts[7] = {};
+    size_t  str_bytes = 0;
+    int32_t max_depth = 0;
+};
+
+void count_vals(const ujson::Val& v, int32_t depth, Stats& stats)
+{
+    const ujson::ValType type = v.get_type();
+    for (int32_t i = 0; i < 7; i++) {
+        if (type == (1U << i)) stats.counts[i]++;
+    }
+    stats.max_depth = std::max(stats.max_depth, depth);
+    if (ujson::vtStr == type) {
+        stats.str_bytes += strlen(v.as_str().get());
+    }
+    else if (ujson::vtArr == type || ujson::vtObj == type) {
+        const ujson::Arr& arr = (ujson::vtObj == type) ? v.as_obj() : v.as_arr();
+        for (const ujson::Val& e : arr.get_elements()) {
+            count_vals(e, depth + 1, stats);
+        }
+    }
+}
+
+int cmd_validate(const Input& in)
+{
+    Timer timer("validate", in.size());
+    ujson::validate(in.data(), in.size());
+    printf("valid\n");
+    return 0;
+}
+
+int cmd_stats(const Input& in)
+{
+    ujson::Json json;
+    size_t mem = 0;
+    Stats stats;
+    {
+        Timer timer("stats", in.size());
+        json.set_threads(get_threads());
+        const ujson::Val& root = json.parse(in.data(), in.size());
+        mem = json.get_mem_usage();
+        count_vals(root, 1, stats);
+    }
+    static const char* const names[7] = { "null", "bool", "int", "f64", "str", "arr", "obj" };
+    size_t total = 0;
+    for (int32_t i = 0; i < 7; i++) {
+        printf("%-8s %zu\n", names[i], stats.counts[i]);
+        total += stats.counts[i];
+    }
+    printf("values   %zu\n", total);
+    printf("strings  %zu bytes\n", stats.str_bytes);
+    printf("depth    %d\n", stats.max_depth);
+    printf("memory   %zu bytes\n", mem);
+    return 0;
+}
+
+int cmd_get(const Input& in, const char* pointer)
+{
+    ujson::Json json;
+    const ujson::Val* v = nullptr;
+    {
+        Timer timer("get", in.size());
+        json.set_threads(get_threads());
+        v = find_pointer(json.parse(in.data(), in.size()), pointer);
+    }
+    if (nullptr == v) {
+        fprintf(stderr, "not found: %s\n", pointer);
+        return 1;
+    }
+    write_val(stdout, *v);
+    fputc('\n', stdout);
+    return 0;
+}
+
+int cmd_minify(const Input& in)
+{
+    std::unique_ptr<char[]> out(new char[in.size() + 1]);
+    size_t len = 0;
+    {
+        Timer timer("minify", in.size());
+        ujson::validate(in.data(), in.size());
+        len = ujson::minify(in.data(), in.size(), out.get());
+    }
+    fwrite(out.get(), 1, len, stdout);
+    fputc('\n', stdout);
+    return 0;
+}
+
+// The input is split at line breaks into one range per thread.
+int cmd_ndjson_count(const Input& in)
+{
+    Timer timer("ndjson-count", in.size());
+    const int32_t threads = static_cast<int32_t>(std::min<size_t>(get_threads(), in.size() / (1 << 20) + 1));
+    std::vector<const char*> bounds{ in.data() };
+    for (int32_t i = 1; i < threads; i++) {
+        const char* p = std::max(in.data() + in.size() * i / threads, bounds.back());
+        p = static_cast<const char*>(memchr(p, '\n', in.data() + in.size() - p));
+        bounds.push_back(p ? p + 1 : in.data() + in.size());
+    }
+    bounds.push_back(in.data() + in.size());
+
+    std::vector<size_t> counts(threads, 0);
+    std::vector<std::exception_ptr> errs(threads);
+    std::vector<std::thread> workers;
+    for (int32_t i = 0; i < threads; i++) {
+        workers.emplace_back([&, i]() {
+            const char* next = bounds[i];
+            const char* end = bounds[i + 1];
+            auto reader = [&](char* buf, size_t size) {
+                const size_t n = std::min<size_t>(size, end - next);
+                memcpy(buf, next, n);
+                next += n;
+                return n;
+            };
+            try {
+                ujson::Json json;
+                counts[i] = json.parse_ndjson(reader, [](const ujson::Val&) {});
+            }
+            catch (...) {
+                errs[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& t : workers) {
+        t.join();
+    }
+    for (int32_t i = 0; i < threads; i++) {
+        if (errs[i]) {
+            try {
+                std::rethrow_exception(errs[i]);
+            }
+            catch (ujson::Err& e) { // the line numbers are relative to the range
+                e.line += static_cast<int32_t>(std::count(in.data(), bounds[i], '\n'));
+                throw;
+            }
+        }
+    }
+    size_t total = 0;
+    for (size_t n : counts) {
+        total += n;
+    }
+    printf("%zu\n", total);
+    return 0;
+}
+
+int usage()
+{
+    fprintf(stderr,
+        "usage: ujson <command> [args] <file>\n"
+        "  validate <file>         checks the syntax\n"
+        "  stats <file>            counts the values by type, the depth and the memory used\n"
+        "  get <pointer> <file>    prints the value at a JSON pointer like /servers/3/port\n"
+        "  minify <file>           removes the blanks, line breaks and // comments\n"
+        "  ndjson-count <file>     counts the documents of a NDJSON file, checking them\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        return usage();
+    }
+    const std::string cmd = argv[1];
+    const char* path = argv[argc - 1];
+    try {
+        if ("get" == cmd && 4 == argc) {
+            return cmd_get(Input(path), argv[2]);
+        }
+        if (3 != argc) {
+            return usage();
+        }
+        if ("validate" == cmd) {
+            return cmd_validate(Input(path));
+        }
+        if ("stats" == cmd) {
+            return cmd_stats(Input(path));
+        }
+        if ("minify" == cmd) {
+            return cmd_minify(Input(path));
+        }
+        if ("ndjson-count" == cmd) {
+            return cmd_ndjson_count(Input(path));
+        }
+        return usage();
+    }
+    catch (const ujson::Err& e) {
+        fprintf(stderr, "%s%s", path, e.get_err_str().c_str());
+        return 1;
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "%s: %s\n", path, e.what());
+        return 1;
+    }
+}
@@ -16,23 +16,177 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <utility>
+#include <memory>
+#include <thread>
+#include <exception>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+#include <deque>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <algorithm>
+#if defined(__x86_64__) || defined(_M_X64)
+#  define UJSON_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#    define UJSON_TARGET(isa)
+#  else
+#    define UJSON_TARGET(isa) __attribute__((target(isa)))
+#  endif
+#endif
+#if defined(UJSON_ZLIB)
+#  include <zlib.h>
+#endif
+#if defined(__linux__)
+#  include <sys/inotify.h>
+#  include <poll.h>
+#  include <unistd.h>
+#endif
 
 namespace ujson {
 
-const uint32_t vtUsedBit = 1U << 31; // Bit in m_type indicating that the value was accessed by the application.
-
+class ValImpl;
 class ArrImpl;
 class ObjImpl;
 
+struct Val::List {
+    std::vector<ValImpl> values;
+    size_t  src_pos   = 0; // offset of '[' or '{' in the input, relative to the parent's one
+    size_t  src_len   = 0; // length up to the closing bracket included
+    int32_t src_lines = 0; // number of line breaks inside
+    mutable std::atomic<uint64_t> hash{ 0 }; // 0 until computed by hash_val(), then shared by the threads
+    virtual ~List() = default;
+};
+
+static uint64_t hash_name(const char* name) // FNV-1a
+{
+    uint64_t h = 14695981039346656037ULL;
+    while (*name) {
+        h = (h ^ static_cast<uint8_t>(*name++)) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint32_t slot_hash(uint64_t hash)
+{
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
 class ValImpl: public Val
 {
 public:
-    struct List {
-        std::vector<ValImpl> values;
-        virtual ~List() = default;
-    };
+    using Val::List;
+    // Members are found by an open addressing table of their indexes. The hash is stored
+    // in the slots to avoid most name comparisons, and allows Path to precompute it.
     struct Dict : public List {
-        std::unordered_map<std::string_view, int32_t> map;
+        struct Slot {
+            uint32_t hash;
+            int32_t  idx; // -1 if the slot is empty
+        };
+        std::vector<Slot> slots; // size is 0 or a power of 2, at least twice the number of members
+        uint64_t shape = 0;      // hash of the names in order, with the number of members it identifies the layout
+
+        static bool same_name(const char* a, const char* b) // inlined, as names are short
+        {
+            while (*a == *b) {
+                if (0 == *a) return true;
+                a++;
+                b++;
+            }
+            return false;
+        }
+
+        int32_t find(const char* name, uint32_t hash) const
+        {
+            if (slots.empty()) return -1;
+            const size_t mask = slots.size() - 1;
+            for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+                const Slot& slot = slots[i];
+                if (slot.idx < 0) return -1;
+                if (slot.hash == hash && same_name(values[slot.idx].m_name, name)) return slot.idx;
+            }
+        }
+
+        // Returns false if the name is already present.
+        bool add(const char* name, uint64_t name_hash, int32_t idx)
+        {
+            const uint32_t hash = slot_hash(name_hash);
+            if (slots.size() < 2 * static_cast<size_t>(idx + 1)) {
+                grow();
+            }
+            const size_t mask = slots.size() - 1;
+            size_t i = hash & mask;
+            for (; slots[i].idx >= 0; i = (i + 1) & mask) {
+                if (slots[i].hash == hash && same_name(values[slots[i].idx].m_name, name)) return false;
+            }
+            slots[i] = { hash, idx };
+            shape = (shape ^ name_hash) * 1099511628211ULL;
+            return true;
+        }
+
+        void grow()
+        {
+            std::vector<Slot> old(slots.empty() ? 8 : slots.size() * 2, Slot{ 0, -1 });
+            old.swap(slots);
+            const size_t mask = slots.size() - 1;
+            for (const Slot& slot : old) {
+                if (slot.idx < 0) continue;
+                size_t i = slot.hash & mask;
+                while (slots[i].idx >= 0) i = (i + 1) & mask;
+                slots[i] = slot;
+            }
+        }
+    };
+    struct Packed : public List { // array containing only numbers, 'values' are created on demand
+        std::vector<int64_t> i64;     // elements if all of them are integers
+        std::vector<double>  f64;     // elements if any of them is a float
+        std::vector<bool>    f64_int; // marks elements in 'f64' that are integers
+        mutable std::once_flag materialized; // 'values' are created once, even by concurrent readers
+
+        int32_t size() const
+        {
+            return static_cast<int32_t>(i64.size() + f64.size());
+        }
+
+        // Returns false if the number can't be stored without losing the type or precision.
+        bool add(ValType type, int64_t i, double f)
+        {
+            if (vtInt == type) {
+                if (f64.empty()) {
+                    i64.push_back(i);
+                    return true;
+                }
+                if (!is_f64_exact(i)) return false;
+                f64.push_back(static_cast<double>(i));
+                f64_int.push_back(true);
+                return true;
+            }
+            if (!i64.empty()) { // first float, move all integers to 'f64'
+                for (int64_t n : i64) {
+                    if (!is_f64_exact(n)) return false;
+                    f64.push_back(static_cast<double>(n));
+                    f64_int.push_back(true);
+                }
+                i64 = std::vector<int64_t>();
+            }
+            f64.push_back(f);
+            f64_int.push_back(false);
+            return true;
+        }
+
+        static bool is_f64_exact(int64_t n)
+        {
+            const int64_t max = int64_t(1) << 53;
+            return n >= -max && n <= max;
+        }
     };
 public:
     
@@ -46,6 +200,7 @@ public:
             m_data.list = nullptr;
         }
         m_type = vtNull;
+        m_len = 0;
     }
 
     ValImpl& init_bool(bool b)
@@ -83,6 +238,14 @@ public:
         return *reinterpret_cast<ArrImpl*>(this);
     }
 
+    ArrImpl& init_packed(Packed* packed)
+    {
+        m_type = vtArr | vtPackedBit;
+        m_data.list = packed;
+        m_len = packed->size();
+        return *reinterpret_cast<ArrImpl*>(this);
+    }
+
     ObjImpl& init_obj()
     {
         m_type = vtObj;
@@ -92,7 +255,9 @@ public:
 
     void mark_as_used() const noexcept
     {
-        m_type |= vtUsedBit;
+        if (0 == (m_type & vtUsedBit)) { // no write once set, so that frozen values can be shared by threads
+            m_type |= vtUsedBit;
+        }
     }
 
     static const ValImpl& from(const Val* v)
@@ -106,19 +271,16 @@ public:
     }
 
 public:
-    union {
-        bool        b;
-        int64_t     i64;
-        double      f64;
-        const char* str;
-        List*       list;
-    }                 m_data = {};      //  8 bytes
-    mutable uint32_t  m_type = vtNull;  //  4 bytes, mutable because we set vtUsedBit when we access the value
-    int32_t           m_line_no = 0;    //  4 bytes
-    const char*       m_name = "";      //  8 bytes
-    int32_t           m_idx = -1;       //  4 bytes
+    using Val::m_data;
+    using Val::m_type;
+    using Val::m_line_no;
+    using Val::m_name;
+    using Val::m_idx;
+    using Val::m_len;
 };
 
+static_assert(sizeof(void*) != 8 || sizeof(ValImpl) == 32, "keep the values compact");
+
 class ArrImpl : public ValImpl
 {
 public:
@@ -130,23 +292,86 @@ public:
 
     int32_t get_len() const
     {
-        return static_cast<int32_t>(m_data.list->values.size());
+        return m_len;
     }
 
     const ValImpl& get_element(int32_t idx) const
     {
+        if (is_packed()) materialize();
         return m_data.list->values.at(idx);
     }
 
     ValImpl& get_element(int32_t idx)
     {
+        if (is_packed()) materialize();
         return m_data.list->values.at(idx);
     }
 
+    bool is_packed() const
+    {
+        return 0 != (m_type & vtPackedBit);
+    }
+
+    Packed& packed() const
+    {
+        return *static_cast<Packed*>(m_data.list);
+    }
+
+    // Fetches an element of a packed array without creating its ValImpl.
+    // Returns false if the element is out of range or is not an integer.
+    bool get_packed_i64(int32_t idx, int64_t& n) const
+    {
+        const Packed& p = packed();
+        if (idx < 0 || idx >= p.size()) return false;
+        if (!p.i64.empty()) {
+            n = p.i64[idx];
+            return true;
+        }
+        if (!p.f64_int[idx]) return false;
+        n = static_cast<int64_t>(p.f64[idx]);
+        return true;
+    }
+
+    bool get_packed_f64(int32_t idx, double& n) const
+    {
+        const Packed& p = packed();
+        if (idx < 0 || idx >= p.size()) return false;
+        n = p.i64.empty() ? p.f64[idx] : static_cast<double>(p.i64[idx]);
+        return true;
+    }
+
+    // Creates the ValImpl elements of a packed array, when the application accesses them as Val.
+    // The elements take the line number of the array. They are created once, so that threads
+    // reading the same document can materialize it, and marked as used, so that reading them
+    // doesn't write to them.
+    void materialize() const
+    {
+        Packed& p = packed();
+        std::call_once(p.materialized, [&] {
+            const int32_t len = p.size();
+            p.values.resize(len);
+            for (int32_t i = 0; i < len; i++) {
+                ValImpl& v = p.values[i];
+                v.m_idx = i;
+                v.m_line_no = m_line_no;
+                if (!p.i64.empty()) {
+                    v.init_int(p.i64[i]);
+                }
+                else if (p.f64_int[i]) {
+                    v.init_int(static_cast<int64_t>(p.f64[i]));
+                }
+                else {
+                    v.init_f64(p.f64[i]);
+                }
+                v.mark_as_used();
+            }
+        });
+    }
+
     ValImpl& add_element()
     {
         ValImpl& v = m_data.list->values.emplace_back();
-        v.m_idx = static_cast<int32_t>(get_len()) - 1;
+        v.m_idx = m_len++;
         return v;
     }
 
@@ -168,14 +393,40 @@ public:
 
     int32_t find(const char* name) const
     {
-        auto& m = map();
-        auto iter = m.find(name);
-        return (iter != m.end()) ? iter->second : -1;
+        return dict().find(name, slot_hash(hash_name(name)));
+    }
+
+    int32_t find(const char* name, uint32_t hash) const
+    {
+        return dict().find(name, hash);
+    }
+
+    uint64_t get_shape() const
+    {
+        return dict().shape;
+    }
+
+    // Adds the first 'count' members, named but not added yet, see Parser::parse_val_obj().
+    // Returns false if a name is duplicated.
+    bool add_named_members(int32_t count)
+    {
+        Dict& d = dict();
+        for (int32_t i = 0; i < count; i++) {
+            if (!d.add(d.values[i].m_name, hash_name(d.values[i].m_name), i)) return false;
+        }
+        return true;
+    }
+
+    // Copies the table of an object with the same member names in the same order.
+    void copy_layout(const Dict& other)
+    {
+        dict().slots = other.slots;
+        dict().shape = other.shape;
     }
 
     bool add_member(const char* name, int32_t idx, ValImpl& v)
     {
-        const bool added = map().try_emplace(name, idx).second;
+        const bool added = dict().add(name, hash_name(name), idx);
         if (added) {
             v.m_name = name;
         }
@@ -183,85 +434,28 @@ public:
     }
 
 private:
-    const std::unordered_map<std::string_view, int32_t>& map() const
+    const Dict& dict() const
     {
-        return static_cast<Dict*>(m_data.list)->map;
+        return *static_cast<Dict*>(m_data.list);
     }
 
-    std::unordered_map<std::string_view, int32_t>& map()
+    Dict& dict()
     {
-        return static_cast<Dict*>(m_data.list)->map;
+        return *static_cast<Dict*>(m_data.list);
     }
 };
 
-template<class T, uint32_t E>
-const T& val_cast(const Val* v)
-{
-    if ((v->get_type() & E) == 0) {
-        throw ErrBadType(*v, T::type());
-    }
-    return *static_cast<const T*>(v);
-}
-
-ValType Val::get_type() const noexcept
-{
-    return static_cast<ValType>(ValImpl::from(this).m_type & ~vtUsedBit);
-}
-
-int32_t Val::get_idx() const noexcept
-{
-    return ValImpl::from(this).m_idx;
-}
-
-const char* Val::get_name() const noexcept
-{
-    return ValImpl::from(this).m_name;
-}
-
-bool Val::is_num() const noexcept
-{
-    return (get_type() & (vtInt | vtF64)) != 0;
-}
-
-const Bool& Val::as_bool() const
-{
-    return val_cast<Bool, vtBool>(this);
-}
-
-const Int& Val::as_int() const
-{
-    return val_cast<Int, vtInt>(this);
-}
-
-const F64& Val::as_f64() const
-{
-    return val_cast<F64, vtInt | vtF64>(this);
-}
-
-const Str& Val::as_str() const
-{
-    return val_cast<Str, vtStr>(this);
-}
-
-const Arr& Val::as_arr() const
-{
-    return val_cast<Arr, vtArr>(this);
-}
-
-const Obj& Val::as_obj() const
-{
-    return val_cast<Obj, vtObj>(this);
-}
 
-int32_t Val::get_line() const
+void Val::raise_bad_type(ValType expected) const
 {
-    return ValImpl::from(this).m_line_no;
+    throw ErrBadType(*this, expected);
 }
 
 static void do_reject_unknow_members(const ValImpl* v)
 {
     if (v->get_type() & (vtArr | vtObj)) {
         const ArrImpl& arr = *static_cast<const ArrImpl*>(v);
+        if (arr.is_packed()) return; // contains only numbers
         for (int32_t i = 0; i < arr.get_len(); i++) {
             v = &arr.get_element(i);
             if (0 == (v->m_type & vtUsedBit) && (arr.get_type() & vtObj)) {
@@ -281,6 +475,7 @@ static void do_ignore_members(const ValImpl* v)
 {
     if (v->get_type() & (vtArr | vtObj)) {
         const ArrImpl& arr = *static_cast<const ArrImpl*>(v);
+        if (arr.is_packed()) return; // contains only numbers
         for (int32_t i = 0; i < arr.get_len(); i++) {
             v = &arr.get_element(i);
             v->mark_as_used();
@@ -294,14 +489,19 @@ void Val::ignore_members() const noexcept
     do_ignore_members(&ValImpl::from(this));
 }
 
-bool Bool::get() const noexcept
-{
-    return ValImpl::from(this).m_data.b;
-}
-
-int64_t Int::get() const noexcept
+// Prepares the values to be read by several threads: marks all of them as used, so that the
+// accessors no longer modify them. The elements of packed arrays are not created here, as
+// materialize() is thread safe.
+static void freeze(const ValImpl* v)
 {
-    return ValImpl::from(this).m_data.i64;
+    v->mark_as_used();
+    if (v->get_type() & (vtArr | vtObj)) {
+        const ArrImpl& arr = *static_cast<const ArrImpl*>(v);
+        if (arr.is_packed()) return;
+        for (int32_t i = 0; i < arr.get_len(); i++) {
+            freeze(&arr.get_element(i));
+        }
+    }
 }
 
 int64_t Int::get(int64_t lo, int64_t hi) const
@@ -327,12 +527,6 @@ int32_t Int::get_i32(int32_t lo, int32_t hi) const
     return static_cast<int32_t>(get(lo, hi));
 }
 
-double F64::get() const noexcept
-{
-    auto& impl = ValImpl::from(this);
-    return (vtInt & impl.get_type()) ? impl.m_data.i64 : impl.m_data.f64;
-}
-
 double F64::get(double lo, double hi) const
 {
     const double num = get();
@@ -342,11 +536,6 @@ double F64::get(double lo, double hi) const
     return num;
 }
 
-const char* Str::get() const noexcept
-{
-    return ValImpl::from(this).m_data.str;
-}
-
 int32_t Str::get_enum_idx(const char* const str_set[], size_t len) const
 {
     const char* str = get();
@@ -356,18 +545,34 @@ int32_t Str::get_enum_idx(const char* const str_set[], size_t len) const
     throw ErrBadEnum(*this);
 }
 
-int32_t Arr::get_len() const noexcept
-{
-    return ArrImpl::from(this).get_len();
-}
-
 const Val& Arr::get_element(int32_t idx) const
 {
+    if (idx < 0 || idx >= get_len()) {
+        throw ErrMemberNotFound(*this, idx);
+    }
     const ValImpl& v = ArrImpl::from(this).get_element(idx);
     v.mark_as_used();
     return v;
 }
 
+// As by get_element(), the elements are marked as accessed, so that an object iterated
+// by the inherited get_elements() doesn't report its members as unknown.
+ValSpan Arr::get_elements() const
+{
+    const auto& self = ArrImpl::from(this);
+    if (self.is_packed()) self.materialize();
+    const auto& values = self.m_data.list->values;
+    for (const ValImpl& v : values) {
+        v.mark_as_used();
+    }
+    return ValSpan(values.data(), get_len(), sizeof(ValImpl));
+}
+
+Obj::Members Obj::get_members() const
+{
+    return Members(get_elements());
+}
+
 bool Arr::get_bool(int32_t idx) const
 {
     return get_element(idx).as_bool().get();
@@ -375,19 +580,106 @@ bool Arr::get_bool(int32_t idx) const
 
 int32_t Arr::get_i32(int32_t idx, int32_t lo, int32_t hi) const
 {
+    auto& self = ArrImpl::from(this);
+    int64_t n = 0;
+    if (self.is_packed() && self.get_packed_i64(idx, n)) {
+        if (lo > hi) {
+            lo = INT32_MIN;
+            hi = INT32_MAX;
+        }
+        if (n >= lo && n <= hi) return static_cast<int32_t>(n);
+    }
     return get_element(idx).as_int().get_i32(lo, hi);
 }
 
 int64_t Arr::get_i64(int32_t idx, int64_t lo, int64_t hi) const
 {
+    auto& self = ArrImpl::from(this);
+    int64_t n = 0;
+    if (self.is_packed() && self.get_packed_i64(idx, n)) {
+        if (lo > hi || (n >= lo && n <= hi)) return n;
+    }
     return get_element(idx).as_int().get(lo, hi);
 }
 
 double Arr::get_f64(int32_t idx, double lo, double hi) const
 {
+    auto& self = ArrImpl::from(this);
+    double n = 0.0;
+    if (self.is_packed() && self.get_packed_f64(idx, n)) {
+        if (lo > hi || (n >= lo && n <= hi)) return n;
+    }
     return get_element(idx).as_f64().get(lo, hi);
 }
 
+const int64_t* Arr::get_i64_data() const noexcept
+{
+    auto& self = ArrImpl::from(this);
+    if (!self.is_packed() || self.packed().i64.empty()) return nullptr;
+    return self.packed().i64.data();
+}
+
+const double* Arr::get_f64_data() const noexcept
+{
+    auto& self = ArrImpl::from(this);
+    if (!self.is_packed() || self.packed().f64.empty()) return nullptr;
+    return self.packed().f64.data();
+}
+
+int32_t Arr::copy_i64(int64_t* dst, int32_t len, int64_t lo, int64_t hi) const
+{
+    const int32_t n = (len < get_len()) ? len : get_len();
+    const int64_t* src = get_i64_data();
+    if (nullptr == src) {
+        for (int32_t i = 0; i < n; i++) {
+            dst[i] = get_i64(i, lo, hi);
+        }
+        return n;
+    }
+    for (int32_t i = 0; i < n; i++) {
+        dst[i] = src[i];
+    }
+    if (lo <= hi) {
+        for (int32_t i = 0; i < n; i++) {
+            if (dst[i] < lo || dst[i] > hi) {
+                std::ignore = get_element(i).as_int().get(lo, hi); // throws
+            }
+        }
+    }
+    return n;
+}
+
+int32_t Arr::copy_f64(double* dst, int32_t len, double lo, double hi) const
+{
+    const int32_t n = (len < get_len()) ? len : get_len();
+    const int64_t* src_i64 = get_i64_data();
+    const double*  src_f64 = get_f64_data();
+    if (nullptr != src_i64) {
+        for (int32_t i = 0; i < n; i++) {
+            dst[i] = static_cast<double>(src_i64[i]);
+        }
+    }
+    else if (nullptr != src_f64) {
+        for (int32_t i = 0; i < n; i++) {
+            dst[i] = src_f64[i];
+        }
+    }
+    else {
+        for (int32_t i = 0; i < n; i++) {
+            dst[i] = get_f64(i, lo, hi);
+        }
+        return n;
+    }
+    if (lo <= hi) {
+        for (int32_t i = 0; i < n; i++) {
+            if (dst[i] < lo || dst[i] > hi) {
+                std::ignore = get_element(i).as_f64().get(lo, hi); // throws
+            }
+        }
+    }
+    return n;
+}
+
 const char* Arr::get_str(int32_t idx) const
 {
     return get_element(idx).as_str().get();
@@ -424,6 +716,103 @@ const Val* Obj::get_member(const char* name, bool required) const
     return (idx >= 0) ? &get_element(idx) : nullptr;
 }
 
+void Obj::get_many(const char* const names[], size_t len, const Val* vals[], bool required) const
+{
+    auto& self = ObjImpl::from(this);
+    const auto& values = self.m_data.list->values;
+    const int32_t count = self.get_len();
+    int32_t next = 0; // the names are often requested in the order of the members, try the next one first
+    std::string missing;
+    for (size_t i = 0; i < len; i++) {
+        int32_t idx = next;
+        if (idx >= count || !ValImpl::Dict::same_name(values[idx].m_name, names[i])) {
+            idx = self.find(names[i]);
+        }
+        if (idx < 0) {
+            vals[i] = nullptr;
+            if (required) {
+                missing += missing.empty() ? "" : ", ";
+                missing += names[i];
+            }
+            continue;
+        }
+        values[idx].mark_as_used();
+        vals[i] = &values[idx];
+        next = idx + 1;
+    }
+    if (!missing.empty()) {
+        throw ErrMemberNotFound(*this, missing.c_str());
+    }
+}
+
+// The layout is the same if the objects have as many members and the same hash of the names in
+// order. As the hash may collide, the names at the indexes found are compared again, which reads
+// one name per slot instead of looking it up, and the names not found are looked up again.
+void RecordViewBase::bind(const Obj& obj, const char* const names[], int32_t idx[], const Val* vals[], size_t len, bool required)
+{
+    auto& self = ObjImpl::from(&obj);
+    const auto& values = self.m_data.list->values;
+    const int32_t count = self.get_len();
+    const uint64_t shape = self.get_shape();
+    bool same = (count == m_count && shape == m_shape);
+    for (size_t i = 0; same && i < len; i++) {
+        same = (idx[i] < 0) ? self.find(names[i]) < 0 : ValImpl::Dict::same_name(values[idx[i]].m_name, names[i]);
+    }
+    if (!same) {
+        int32_t next = 0; // as in Obj::get_many()
+        for (size_t i = 0; i < len; i++) {
+            idx[i] = (next < count && ValImpl::Dict::same_name(values[next].m_name, names[i])) ? next : self.find(names[i]);
+            next = (idx[i] >= 0) ? idx[i] + 1 : next;
+        }
+    }
+    m_obj = &obj;
+    m_count = count;
+    m_shape = shape;
+    std::string missing;
+    for (size_t i = 0; i < len; i++) {
+        vals[i] = (idx[i] >= 0) ? &values[idx[i]] : nullptr;
+        if (idx[i] >= 0) {
+            values[idx[i]].mark_as_used();
+        }
+        else if (required) {
+            missing += missing.empty() ? "" : ", ";
+            missing += names[i];
+        }
+    }
+    if (!missing.empty()) {
+        m_count = -1;
+        throw ErrMemberNotFound(obj, missing.c_str());
+    }
+}
+
+void RecordViewBase::raise_not_found(const char* name) const
+{
+    throw ErrMemberNotFound(*m_obj, name);
+}
+
+// The layout is verified as by RecordView, a miss is looked up again.
+const Val* MemberCache::get_member(const Obj& obj, bool required)
+{
+    auto& self = ObjImpl::from(&obj);
+    const int32_t count = self.get_len();
+    const uint64_t shape = self.get_shape();
+    if (count != m_count || shape != m_shape || m_idx < 0
+        || !ValImpl::Dict::same_name(self.m_data.list->values[m_idx].m_name, m_name)) {
+        m_idx = self.find(m_name);
+        m_count = count;
+        m_shape = shape;
+    }
+    if (m_idx < 0) {
+        if (required) {
+            throw ErrMemberNotFound(obj, m_name);
+        }
+        return nullptr;
+    }
+    const ValImpl& v = self.m_data.list->values[m_idx];
+    v.mark_as_used();
+    return &v;
+}
+
 bool Obj::get_bool(const char* name, const bool* def) const
 {
     auto* v = get_member(name, nullptr == def);
@@ -475,527 +864,3698 @@ const Obj& Obj::get_obj(const char* name) const
     return get_member(name)->as_obj();
 }
 
-class Parser
+// Resolves the member indexes of a fixed set of names for a sequence of objects.
+// Objects of the same layout reuse the indexes found in the previous object,
+// verified by a string compare instead of a hash lookup.
+class MemberResolver
 {
 public:
-    Parser(char* str) :
-        m_next{ str },
-        m_line_count{ 1 }
+    MemberResolver(const Column* cols, size_t len) :
+        m_cols{ cols },
+        m_idx(len, -1)
     {
     }
 
-    ValImpl* parse()
+    const int32_t* resolve(const ObjImpl& obj)
     {
-        ValImpl* v = parse_val(nullptr);
-        skip_white_space();
-        if (0 != *m_next) {
-            throw ErrSyntax("invalid value syntax", m_line_count);
+        const int32_t len = obj.get_len();
+        for (size_t k = 0; k < m_idx.size(); k++) {
+            const int32_t idx = m_idx[k];
+            if (idx >= 0 && idx < len && 0 == strcmp(obj.get_element(idx).m_name, m_cols[k].name)) {
+                continue;
+            }
+            m_idx[k] = obj.find(m_cols[k].name);
         }
-        return v;
+        return m_idx.data();
     }
 
 private:
-    
-    ValImpl* parse_val(ArrImpl* parent)
-    {
-        skip_white_space();
-        if (auto v = parse_val_null(parent); v) { return v; }
-        if (auto v = parse_val_bool(parent); v) { return v; }
-        if (auto v = parse_val_num (parent); v) { return v; }
-        if (auto v = parse_val_str (parent); v) { return v; }
-        if (auto v = parse_val_arr (parent); v) { return v; }
-        if (auto v = parse_val_obj (parent); v) { return v; }
-        throw ErrSyntax("invalid syntax", m_line_count);
-        return nullptr;
+    const Column*        m_cols;
+    std::vector<int32_t> m_idx;
+};
+
+// Fetches the columns of the array elements in range [begin, end).
+// Strings are encoded with a dictionary local to this range, merged later by get_columns().
+static void get_columns_range(
+    const Arr& arr,
+    Column* cols,
+    size_t len,
+    int32_t begin,
+    int32_t end,
+    std::vector<std::vector<const char*>>& dicts)
+{
+    MemberResolver resolver(cols, len);
+    std::vector<std::unordered_map<std::string_view, int32_t>> maps(len);
+    dicts.assign(len, {});
+    for (int32_t i = begin; i < end; i++) {
+        const Obj& obj = arr.get_obj(i);
+        const int32_t* idx = resolver.resolve(ObjImpl::from(&obj));
+        for (size_t k = 0; k < len; k++) {
+            Column& col = cols[k];
+            const Val* v = (idx[k] >= 0) ? &obj.get_element(idx[k]) : nullptr;
+            if (nullptr == v && col.required) {
+                throw ErrMemberNotFound(obj, col.name);
+            }
+            switch (col.type) {
+            case vtBool:
+                col.i64[i] = v ? v->as_bool().get() : col.def_i64;
+                break;
+            case vtInt:
+                col.i64[i] = v ? v->as_int().get() : col.def_i64;
+                break;
+            case vtF64:
+                col.f64[i] = v ? v->as_f64().get() : col.def_f64;
+                break;
+            default: {
+                const char* str = v ? v->as_str().get() : col.def_str;
+                auto [iter, added] = maps[k].try_emplace(str, static_cast<int32_t>(dicts[k].size()));
+                if (added) {
+                    dicts[k].push_back(str);
+                }
+                col.codes[i] = iter->second;
+                break;
+            }
+            }
+        }
     }
+}
 
-    void raise_bad_utf()
-    {
-        throw ErrSyntax("invalid string syntax: bad utf-16 codepoint", m_line_count);
+void Arr::get_columns(Column* cols, size_t len, int32_t threads) const
+{
+    const int32_t n = get_len();
+    for (size_t k = 0; k < len; k++) {
+        Column& col = cols[k];
+        if (0 == (col.type & (vtBool | vtInt | vtF64 | vtStr)) || (col.type & (col.type - 1))) {
+            throw std::invalid_argument("ujson::Column::type must be vtBool, vtInt, vtF64 or vtStr");
+        }
+        col.i64.clear();
+        col.f64.clear();
+        col.codes.clear();
+        col.dict.clear();
+        if (col.type & (vtBool | vtInt)) col.i64.resize(n);
+        if (col.type & vtF64) col.f64.resize(n);
+        if (col.type & vtStr) col.codes.resize(n);
+    }
+    if (n > 0 && ArrImpl::from(this).is_packed()) {
+        get_obj(0); // throws ErrBadType here, rather than materializing the elements in each thread
     }
 
-    ValImpl* add_val(ArrImpl* parent)
-    {
-        ValImpl* v = (parent)?
-            &parent->add_element() :
-            new ValImpl;
-        v->m_line_no = m_line_count;
-        return v;
+    const int32_t min_per_thread = 4096; // not worth starting a thread for fewer elements
+    if (threads > n / min_per_thread) threads = n / min_per_thread;
+    if (threads < 1) threads = 1;
+
+    std::vector<std::vector<std::vector<const char*>>> dicts(threads); // [thread][column][code]
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> workers;
+    auto run = [&](int32_t t) {
+        try {
+            const int32_t begin = static_cast<int32_t>(int64_t(n) * t / threads);
+            const int32_t end = static_cast<int32_t>(int64_t(n) * (t + 1) / threads);
+            get_columns_range(*this, cols, len, begin, end, dicts[t]);
+        }
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    for (int32_t t = 1; t < threads; t++) {
+        workers.emplace_back(run, t);
+    }
+    run(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (auto& e : errors) {
+        if (e) std::rethrow_exception(e); // report the error of the lowest element index
     }
 
-    ObjImpl* parse_val_obj(ArrImpl* parent)
-    {
-        ObjImpl* obj = nullptr;
-        if (!skip_text("{")) return obj;
-        obj = &add_val(parent)->init_obj();
-        while (true) {
-            skip_white_space();
-            if (skip_text("}")) break;
-            const char* name = parse_str();
-            if (nullptr == name) {
-                throw ErrSyntax("invalid object syntax: expected member name or '}'", m_line_count);
-            }
-            skip_white_space();
-            if (!skip_text(":")) {
-                throw ErrSyntax("invalid object syntax: expected ':' after member name", m_line_count);
-            }
-            skip_white_space();
-            int32_t idx = obj->get_len();
-            ValImpl* v = parse_val(obj);
-            if (!obj->add_member(name, idx, *v)) {
-                throw ErrSyntax("invalid object syntax: duplicate member name", m_line_count);
+    // Merge the per-thread dictionaries and translate the codes.
+    for (size_t k = 0; k < len; k++) {
+        Column& col = cols[k];
+        if (0 == (col.type & vtStr)) continue;
+        col.dict = std::move(dicts[0][k]);
+        if (threads == 1) continue;
+        std::unordered_map<std::string_view, int32_t> map;
+        for (int32_t code = 0; code < static_cast<int32_t>(col.dict.size()); code++) {
+            map.emplace(col.dict[code], code);
+        }
+        for (int32_t t = 1; t < threads; t++) {
+            const auto& dict = dicts[t][k];
+            std::vector<int32_t> remap(dict.size());
+            for (size_t code = 0; code < dict.size(); code++) {
+                auto [iter, added] = map.try_emplace(dict[code], static_cast<int32_t>(col.dict.size()));
+                if (added) {
+                    col.dict.push_back(dict[code]);
+                }
+                remap[code] = iter->second;
             }
-            skip_white_space();
-            if (skip_text("}")) break;
-            if (!skip_text(",")) {
-                throw ErrSyntax("invalid object syntax: expected ',' or '}'", m_line_count);
+            const int32_t begin = static_cast<int32_t>(int64_t(n) * t / threads);
+            const int32_t end = static_cast<int32_t>(int64_t(n) * (t + 1) / threads);
+            for (int32_t i = begin; i < end; i++) {
+                col.codes[i] = remap[col.codes[i]];
             }
         }
-        return obj;
     }
+}
 
-    ArrImpl* parse_val_arr(ArrImpl* parent)
-    {
-        ArrImpl* arr = nullptr;
-        if (!skip_text("[")) return arr;
-        arr = &add_val(parent)->init_arr();
-        while (true) {
-            skip_white_space();
-            if (skip_text("]")) break;
-            std::ignore = parse_val(arr);
-            skip_white_space();
-            if (skip_text("]")) break;
-            if (!skip_text(",")) {
-                throw ErrSyntax("invalid array syntax: expected ',' or ']'", m_line_count);
+static uint32_t hash_i64(int64_t key)
+{
+    return slot_hash(static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL);
+}
+
+// The keys are fetched and hashed by the threads, then added in the order of the elements.
+ArrIndex Arr::build_index(const char* name, bool required, int32_t threads) const
+{
+    const int32_t n = get_len();
+    if (n > 0 && ArrImpl::from(this).is_packed()) {
+        get_obj(0); // as in get_columns()
+    }
+    const int32_t min_per_thread = 4096; // as in get_columns()
+    if (threads > n / min_per_thread) threads = n / min_per_thread;
+    if (threads < 1) threads = 1;
+
+    std::vector<ArrIndex::Slot> keys(n);
+    std::vector<std::exception_ptr> errors(threads);
+    std::vector<std::thread> workers;
+    auto run = [&](int32_t t) {
+        try {
+            const int32_t begin = static_cast<int32_t>(int64_t(n) * t / threads);
+            const int32_t end = static_cast<int32_t>(int64_t(n) * (t + 1) / threads);
+            MemberCache cache(name); // the elements have usually the same layout
+            for (int32_t i = begin; i < end; i++) {
+                const Val* key = cache.get_member(get_obj(i), required);
+                uint32_t hash = 0;
+                if (nullptr == key) {
+                    keys[i] = { 0, -1, nullptr };
+                    continue;
+                }
+                if (vtStr == key->get_type()) {
+                    hash = slot_hash(hash_name(key->as_str().get()));
+                }
+                else if (vtInt == key->get_type()) {
+                    hash = hash_i64(key->as_int().get());
+                }
+                else {
+                    throw ErrBadType(*key, vtStr);
+                }
+                keys[i] = { hash, i, key };
             }
         }
-        return arr;
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    for (int32_t t = 1; t < threads; t++) {
+        workers.emplace_back(run, t);
+    }
+    run(0);
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (auto& e : errors) {
+        if (e) std::rethrow_exception(e); // report the error of the lowest element index
     }
 
-    ValImpl* parse_val_null(ArrImpl* parent)
-    {
-        ValImpl* v = nullptr;
-        if (skip_text("null")) {
-            v = add_val(parent);
+    ArrIndex index;
+    index.m_name = name;
+    size_t size = 8;
+    while (size < 2 * static_cast<size_t>(n)) size *= 2;
+    index.m_slots.assign(size, ArrIndex::Slot{ 0, -1, nullptr });
+    const size_t mask = size - 1;
+    for (const ArrIndex::Slot& key : keys) {
+        if (key.idx < 0) continue;
+        const ValType type = key.key->get_type();
+        if (vtNone == index.m_key_type) {
+            index.m_key_type = type;
         }
-        return v;
+        else if (type != index.m_key_type) {
+            throw ErrBadType(*key.key, index.m_key_type);
+        }
+        const char* str = (vtStr == type) ? key.key->as_str().get() : nullptr;
+        const int64_t i64 = (vtInt == type) ? key.key->as_int().get() : 0;
+        if (index.find_slot(key.hash, type, str, i64)) continue; // the first one is kept
+        size_t i = key.hash & mask;
+        while (index.m_slots[i].idx >= 0) i = (i + 1) & mask;
+        index.m_slots[i] = key;
+        index.m_len++;
     }
+    return index;
+}
 
-    ValImpl* parse_val_bool(ArrImpl* parent)
+const ArrIndex::Slot* ArrIndex::find_slot(uint32_t hash, ValType type, const char* str, int64_t i64) const noexcept
+{
+    if (m_slots.empty() || type != m_key_type) return nullptr;
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot& slot = m_slots[i];
+        if (slot.idx < 0) return nullptr;
+        if (slot.hash != hash) continue;
+        if (vtStr == type ? (0 == strcmp(slot.key->as_str().get(), str)) : (slot.key->as_int().get() == i64)) return &slot;
+    }
+}
+
+int32_t ArrIndex::find_str(const char* key) const noexcept
+{
+    const Slot* slot = find_slot(slot_hash(hash_name(key)), vtStr, key, 0);
+    return slot ? slot->idx : -1;
+}
+
+int32_t ArrIndex::find_i64(int64_t key) const noexcept
+{
+    const Slot* slot = find_slot(hash_i64(key), vtInt, nullptr, key);
+    return slot ? slot->idx : -1;
+}
+
+// Validation rules of a value, compiled from the JSON schema format described in README.md.
+struct SchemaNode
+{
+    uint32_t types    = vtNull | vtBool | vtInt | vtF64 | vtStr | vtArr | vtObj;
+    ValType  expected = vtNone; // reported by ErrBadType
+    bool     required = true;   // used if this is a member
+
+    bool    int_range = false;  // if true, integers are checked against [ilo, ihi], otherwise against [flo, fhi]
+    int64_t ilo = INT64_MIN;
+    int64_t ihi = INT64_MAX;
+    double  flo = -std::numeric_limits<double>::infinity();
+    double  fhi =  std::numeric_limits<double>::infinity();
+
+    std::vector<const char*> enums;
+
+    int32_t min_len = 0;
+    int32_t max_len = INT32_MAX;
+    const SchemaNode* items = nullptr;
+
+    std::unordered_map<std::string_view, const SchemaNode*> members;
+    std::vector<const char*> required_members;
+    bool additional = true; // if false, members not listed in 'members' are rejected
+
+    const SchemaNode* find_member(const char* name) const
     {
-        ValImpl* v = nullptr;
-        bool b = false;
-        if (skip_text("false")) {
-            b = false;
-        }
-        else if (skip_text("true")) {
-            b = true;
-        }
-        else {
-            return v;
-        }
-        v = add_val(parent);
-        v->init_bool(b);
-        return v;
+        auto iter = members.find(name);
+        return (iter != members.end()) ? iter->second : nullptr;
     }
 
-    ValImpl* parse_val_num(ArrImpl* parent)
+    bool accepts_num(ValType type, int64_t i64, double f64) const
     {
-        ValImpl* v = nullptr;
-        bool negative = false;
-        bool is_float = false;
-        char* p = m_next;
-        if ('-' == *p) {
-            negative = true;
-            p += 1;
-        }
-        char* num_start = p;
-        while (*p >= '0' && *p <= '9') p += 1;
-        if (p == m_next) return v; // not a number as we didn't encounter ('-', '0'...'9')
-        if (p == num_start) {
-            throw ErrSyntax("invalid number syntax: no digits after '-'", m_line_count);
-        }
-        if ('0' == *num_start && (p - num_start) > 1) {
-            throw ErrSyntax("invalid number syntax: can't start with '0' if followed by another digit", m_line_count);
-        }
-        if ('.' == *p) {
-            is_float = true;
-            p += 1;
-            while (*p >= '0' && *p <= '9') p += 1;
-        }
-        if ('E' == *p || 'e' == *p) {
-            is_float = true;
-            p += 1;
-            if ('+' == *p || '-' == *p) p += 1;
-            while (*p >= '0' && *p <= '9') p += 1;
+        if (0 == (types & type)) return false;
+        if (vtInt == type && int_range) return i64 >= ilo && i64 <= ihi;
+        return f64 >= flo && f64 <= fhi;
+    }
+
+    void check(const ValImpl& v) const
+    {
+        const ValType type = v.get_type();
+        if (0 == (types & type)) {
+            throw ErrBadType(v, expected);
         }
-        if (!is_float) {
-            // If integer exceeds -9223372036854775808 ... 9223372036854775807
-            // we should raise an error as it will not fit in 64 bits.
-            // Note this could be implemented via strtoll() and checking errno for ERANGE.
-            // 
-            // We test below that the absolute number will not exceed -a*10 + b
-            // For this, we work with a negative value of 'n',
-            // otherwise it may not fit the lower limit as a positive value.
-            //
-            const int64_t a = -922337203685477580;
-            const int b = negative ? 8 : 7;
-            int64_t n = 0;
-            p = num_start;
-            while (true) {
-                char c = *p;
-                if (c < '0' || c > '9') break;
-                int d = c - '0';
-                if (n < a || n == a && d > b) {
-                    throw ErrSyntax("invalid number syntax: integer doesn't fit in 64 bits", m_line_count);
-                }
-                n = n * 10 - d;
-                p += 1;
+        switch (type) {
+        case vtInt:
+            if (int_range) {
+                std::ignore = v.as_int().get(ilo, ihi);
+                break;
             }
-            if (!negative) n = -n;
-            v = add_val(parent);
-            v->init_int(n);
-        }
-        else { // It is a float
-            char* end = m_next;
-            errno = 0;
-            double n = std::strtod(m_next, &end);
-            if (ERANGE == errno) {
-                throw ErrSyntax("invalid number syntax: float is too huge", m_line_count);
+            [[fallthrough]];
+        case vtF64:
+            std::ignore = v.as_f64().get(flo, fhi);
+            break;
+        case vtStr:
+            if (!enums.empty()) {
+                std::ignore = v.as_str().get_enum_idx(enums.data(), enums.size());
             }
-            if (end != p) {
-                throw ErrSyntax("invalid number syntax: bad float format", m_line_count);
+            break;
+        case vtArr: {
+            const int32_t len = v.as_arr().get_len();
+            if (len < min_len || len > max_len) {
+                throw ErrBadLen(v, min_len, max_len);
             }
-            v = add_val(parent);
-            v->init_f64(n);
+            break;
+        }
+        default:
+            break;
         }
-        m_next = p;
-        return v;
     }
 
-    ValImpl* parse_val_str(ArrImpl* parent)
+    void check_packed(const ArrImpl& arr) const
     {
-        ValImpl* v = nullptr;
-        const char* str = parse_str();
-        if (nullptr != str) {
-            v = add_val(parent);
-            v->init_str(str);
+        const ValImpl::Packed& p = arr.packed();
+        for (int32_t i = 0; i < p.size(); i++) {
+            int64_t i64 = 0;
+            double  f64 = 0.0;
+            const ValType type = arr.get_packed_i64(i, i64) ? vtInt : vtF64;
+            std::ignore = arr.get_packed_f64(i, f64);
+            if (!accepts_num(type, i64, f64)) {
+                check(arr.get_element(i)); // throws
+            }
         }
-        return v;
     }
 
-    const char* parse_str()
+    void check_required(const ObjImpl& obj) const
     {
-        const char* str = nullptr;
-        if (!skip_text("\"")) return str;
-        char* str_end = m_next;
-        str = m_next;
-        while (true) {
-            char c = *m_next++;
-            if ('"' == c) break;
-            if (c == '\r' || c == '\n' || c == 0) {
-                throw ErrSyntax("invalid string syntax: line ending before closing quotes", m_line_count);
-            }
-            if (c < ' ') {
-                throw ErrSyntax("invalid string syntax: control characters not allowed", m_line_count);
-            }
-            if ('\\' == c) {
-                switch (*(m_next++))
-                {
-                case '\\': c = '\\'; break;
-                case '/':  c = '/' ; break;
-                case 'b':  c = '\b'; break;
-                case 'f':  c = '\f'; break;
-                case 'n':  c = '\n'; break;
-                case 'r':  c = '\r'; break;
-                case 't':  c = '\t'; break;
-                case 'u':
-                    str_end = parse_encoding(str_end);
-                    continue;
-                default:
-                    m_next -= 1;
-                    throw ErrSyntax("invalid string syntax: bad escape character", m_line_count);
-                }
+        for (const char* name : required_members) {
+            if (obj.find(name) < 0) {
+                throw ErrMemberNotFound(obj.as_obj(), name);
             }
-            *str_end++ = c;
         }
-        *str_end = 0; // replace ending '"' with 0
-        return str;
     }
+};
 
-    char* parse_encoding(char* str_end)
+class SchemaImpl
+{
+public:
+    void compile(const char* str, size_t len)
     {
-        uint32_t code = parse_hex4();
-        if (code >= 0xDC00 && code <= 0xDFFF) {
-            raise_bad_utf(); // orphan low surrogate
-        }
-        if (code >= 0xD800 && code <= 0xDBFF) { // high surrogate
-            // Expect next \uXXXX escape with low surrogate
-            if (!skip_text("\\u")) {
-                raise_bad_utf(); // low surrogate not specified
-            }
-            uint32_t code2 = parse_hex4();
-            if (code2 < 0xDC00 || code2 > 0xDFFF) {
-                raise_bad_utf(); // invalid low surrogate
+        const Val& root = m_json.parse(str, len);
+        m_root = compile_node(root);
+        root.reject_unknow_members(); // catch typos in the schema
+    }
+
+    const SchemaNode* root() const
+    {
+        return m_root;
+    }
+
+private:
+    const SchemaNode* compile_node(const Val& v)
+    {
+        static const std::array<const char*, 8> type_names { "null", "bool", "int", "float",       "str", "arr", "obj", "any"  };
+        static const std::array<uint32_t, 8>    type_masks { vtNull, vtBool, vtInt, vtInt | vtF64, vtStr, vtArr, vtObj, ~0U    };
+        static const std::array<ValType, 8>     type_exp   { vtNull, vtBool, vtInt, vtF64,         vtStr, vtArr, vtObj, vtNone };
+
+        const Obj& obj = v.as_obj();
+        SchemaNode& node = *m_nodes.emplace_back(new SchemaNode);
+
+        if (const Val* t = obj.get_member("type", false); t) {
+            node.types = 0;
+            const bool is_list = (vtArr == t->get_type());
+            const int32_t len = is_list ? t->as_arr().get_len() : 1;
+            for (int32_t i = 0; i < len; i++) {
+                const Str& name = is_list ? t->as_arr().get_element(i).as_str() : t->as_str();
+                const int32_t idx = name.get_enum_idx(type_names.data(), type_names.size());
+                node.types |= type_masks[idx];
+                if (vtNone == node.expected) node.expected = type_exp[idx];
             }
-            code = (((code - 0xD800) << 10) | (code2 - 0xDC00)) + 0x10000;
         }
-        if (code <= 0x0007F) {      // binary (0000 0000 0xxx xxxx) -> (0xxx xxxx)
-            *str_end++ = static_cast<char>(code);
+
+        const Val* lo = obj.get_member("min", false);
+        const Val* hi = obj.get_member("max", false);
+        node.int_range = (lo || hi) && (!lo || vtInt == lo->get_type()) && (!hi || vtInt == hi->get_type());
+        if (lo) {
+            node.flo = lo->as_f64().get();
+            if (node.int_range) node.ilo = lo->as_int().get();
+        }
+        if (hi) {
+            node.fhi = hi->as_f64().get();
+            if (node.int_range) node.ihi = hi->as_int().get();
         }
-        else if (code <= 0x007FF) { // binary (0000 0xxx xxyy yyyy) -> (110x xxxx) (10yy yyyy)
-            *str_end++ = static_cast<char>(0xC0 | ((code >> 6) & 0xFF));
-            *str_end++ = static_cast<char>(0x80 | (code & 0x3F));
+
+        if (const Val* e = obj.get_member("enum", false); e) {
+            const Arr& arr = e->as_arr();
+            for (int32_t i = 0; i < arr.get_len(); i++) {
+                node.enums.push_back(arr.get_str(i));
+            }
         }
-        else if (code <= 0x0FFFF) { // binary (xxxx yyyy yyzz zzzz) -> (1110 xxxx) (10yy yyyy) (10zz zzzz)
-            *str_end++ = static_cast<char>(0xE0 | ((code >> 12) & 0xFF));
-            *str_end++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
-            *str_end++ = static_cast<char>(0x80 | (code & 0x3F));
+
+        node.min_len = obj.get_i32("min_len", 0, INT32_MAX, node.min_len);
+        node.max_len = obj.get_i32("max_len", 0, INT32_MAX, node.max_len);
+        if (const Val* items = obj.get_member("items", false); items) {
+            node.items = compile_node(*items);
         }
-        else { // code <= 0x10FFFF  // binary (000x xxyy yyyy zzzz zzuu uuuu) -> (1111 0xxx) (10yy yyyy) (10zz zzzz) (10uu uuuu)
-            *str_end++ = static_cast<char>(0xF0 | ((code >> 18) & 0xFF));
-            *str_end++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
-            *str_end++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
-            *str_end++ = static_cast<char>(0x80 | (code & 0x3F));
+
+        if (const Val* m = obj.get_member("members", false); m) {
+            const Obj& members = m->as_obj();
+            for (int32_t i = 0; i < members.get_len(); i++) {
+                const SchemaNode* member = compile_node(members.get_element(i));
+                node.members.emplace(members.get_member_name(i), member);
+                if (member->required) {
+                    node.required_members.push_back(members.get_member_name(i));
+                }
+            }
         }
-        return str_end;
+        node.additional = obj.get_bool("additional", true);
+        node.required = obj.get_bool("required", true);
+        return &node;
     }
 
-    uint32_t parse_hex4()
+private:
+    Json m_json; // keeps the strings referenced by the nodes
+    std::vector<std::unique_ptr<SchemaNode>> m_nodes;
+    const SchemaNode* m_root = nullptr;
+};
+
+// Limits with 0 replaced by the maximum value, so that they can be checked by one comparison.
+struct MaxLimits
+{
+    explicit MaxLimits(const Limits& limits) :
+        nodes  { or_max(limits.max_nodes)   },
+        depth  { or_max(limits.max_depth)   },
+        str_len{ or_max(limits.max_str_len) },
+        entries{ or_max(limits.max_entries) }
     {
-        uint32_t code = 0;
-        char* p = m_next;
-        for (int i = 0; i < 4; i++) {
-            char c = *p++;
-            code <<= 4;
-            if (c >= '0' && c <= '9') {
-                c -= '0';
-            }
-            else if (c >= 'A' && c <= 'F') {
-                c -= 'A' - 10;
-            }
-            else if (c >= 'a' && c <= 'f') {
-                c -= 'a' - 10;
-            }
-            else {
-                raise_bad_utf(); // bad hex4 format
+    }
+
+    static int32_t or_max(int32_t n)
+    {
+        return (n > 0) ? n : INT32_MAX;
+    }
+
+    int32_t nodes;
+    int32_t depth;
+    int32_t str_len;
+    int32_t entries;
+};
+
+static bool limits_values(const Limits& limits) // other than the input length
+{
+    return limits.max_nodes || limits.max_depth || limits.max_str_len || limits.max_entries;
+}
+
+static void check_max_bytes(size_t len, const Limits& limits)
+{
+    if (limits.max_bytes > 0 && len > limits.max_bytes) {
+        throw ErrLimit("limit exceeded: input is too long", 1);
+    }
+}
+
+static char* encode_utf8(uint32_t code, char* str_end)
+{
+    if (code <= 0x0007F) {      // binary (0000 0000 0xxx xxxx) -> (0xxx xxxx)
+        *str_end++ = static_cast<char>(code);
+    }
+    else if (code <= 0x007FF) { // binary (0000 0xxx xxyy yyyy) -> (110x xxxx) (10yy yyyy)
+        *str_end++ = static_cast<char>(0xC0 | ((code >> 6) & 0xFF));
+        *str_end++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code <= 0x0FFFF) { // binary (xxxx yyyy yyzz zzzz) -> (1110 xxxx) (10yy yyyy) (10zz zzzz)
+        *str_end++ = static_cast<char>(0xE0 | ((code >> 12) & 0xFF));
+        *str_end++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *str_end++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else { // code <= 0x10FFFF  // binary (000x xxyy yyyy zzzz zzuu uuuu) -> (1111 0xxx) (10yy yyyy) (10zz zzzz) (10uu uuuu)
+        *str_end++ = static_cast<char>(0xF0 | ((code >> 18) & 0xFF));
+        *str_end++ = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        *str_end++ = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        *str_end++ = static_cast<char>(0x80 | (code & 0x3F));
+    }
+    return str_end;
+}
+
+// Kernels scanning runs of bytes, selected once according to the CPU features.
+// They never read at or beyond 'end', and return 'end' if the run doesn't stop before it.
+struct Kernels
+{
+    const char* (*skip_blanks)(const char* p, const char* end); // skips ' ' and '\t'
+    const char* (*skip_str)(const char* p, const char* end);    // stops at '"', '\\' or a control character
+    void (*classify)(const char* p, uint64_t masks[4]);         // sets the bits of 64 bytes: '"', '\\', blanks and line breaks, '/',
+                                                                // nullptr if scanning runs is faster
+    char* (*compress)(const char* p, uint64_t keep, char* out); // moves the bytes of the 64 whose bit is set, returns the end
+};
+
+struct CompressTable // for each byte of a keep mask, the indexes of the kept bytes
+{
+    uint64_t idx[256];
+    uint8_t  count[256];
+
+    constexpr CompressTable() : idx{}, count{}
+    {
+        for (uint32_t m = 0; m < 256; m++) {
+            for (uint32_t i = 0; i < 8; i++) {
+                if (m & (1U << i)) {
+                    idx[m] |= static_cast<uint64_t>(i) << (8 * count[m]++);
+                }
+            }
+        }
+    }
+};
+
+static constexpr CompressTable g_compress_table;
+
+static const char* skip_blanks_scalar(const char* p, const char* end)
+{
+    while (p < end && (' ' == *p || '\t' == *p)) p++;
+    return p;
+}
+
+static const char* skip_str_scalar(const char* p, const char* end)
+{
+    while (p < end) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        if ('"' == c || '\\' == c || c < ' ') break;
+        p++;
+    }
+    return p;
+}
+
+static char* compress_scalar(const char* p, uint64_t keep, char* out)
+{
+    for (uint32_t i = 0; i < 64; i += 8, keep >>= 8) {
+        const uint32_t m = keep & 0xFF;
+        uint64_t idx = g_compress_table.idx[m];
+        for (uint32_t n = g_compress_table.count[m]; n > 0; n--, idx >>= 8) {
+            *out++ = p[i + (idx & 7)];
+        }
+    }
+    return out;
+}
+
+static int32_t first_bit(uint64_t mask) // mask must not be 0
+{
+#if defined(_MSC_VER) && defined(UJSON_X86)
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return static_cast<int32_t>(idx);
+#elif defined(_MSC_VER)
+    int32_t idx = 0;
+    for (; 0 == (mask & 1); mask >>= 1) idx++;
+    return idx;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+#if defined(UJSON_X86)
+
+UJSON_TARGET("sse2")
+static const char* skip_blanks_sse2(const char* p, const char* end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab   = _mm_set1_epi8('\t');
+    for (; end - p >= 16; p += 16) {
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, tab));
+        const uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(blank)) & 0xFFFF;
+        if (mask) return p + first_bit(mask);
+    }
+    return skip_blanks_scalar(p, end);
+}
+
+UJSON_TARGET("sse2")
+static const char* skip_str_sse2(const char* p, const char* end)
+{
+    const __m128i quote  = _mm_set1_epi8('"');
+    const __m128i slash  = _mm_set1_epi8('\\');
+    const __m128i ctrl   = _mm_set1_epi8(0x1F);
+    for (; end - p >= 16; p += 16) {
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i stop = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(c, quote), _mm_cmpeq_epi8(c, slash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(c, ctrl), c)); // unsigned c <= 0x1F
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(stop));
+        if (mask) return p + first_bit(mask);
+    }
+    return skip_str_scalar(p, end);
+}
+
+UJSON_TARGET("sse2")
+static void classify_sse2(const char* p, uint64_t masks[4])
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab   = _mm_set1_epi8('\t');
+    const __m128i cr    = _mm_set1_epi8('\r');
+    const __m128i lf    = _mm_set1_epi8('\n');
+    const __m128i div   = _mm_set1_epi8('/');
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+    for (uint32_t i = 0; i < 64; i += 16) {
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, tab)),
+                                           _mm_or_si128(_mm_cmpeq_epi8(c, cr), _mm_cmpeq_epi8(c, lf)));
+        masks[0] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, quote)))) << i;
+        masks[1] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, slash)))) << i;
+        masks[2] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(blank))) << i;
+        masks[3] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, div)))) << i;
+    }
+}
+
+UJSON_TARGET("avx2")
+static const char* skip_blanks_avx2(const char* p, const char* end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab   = _mm256_set1_epi8('\t');
+    for (; end - p >= 32; p += 32) {
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(c, space), _mm256_cmpeq_epi8(c, tab));
+        const uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+        if (mask) return p + first_bit(mask);
+    }
+    return skip_blanks_sse2(p, end);
+}
+
+UJSON_TARGET("avx2")
+static const char* skip_str_avx2(const char* p, const char* end)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i ctrl  = _mm256_set1_epi8(0x1F);
+    for (; end - p >= 32; p += 32) {
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i stop = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(c, quote), _mm256_cmpeq_epi8(c, slash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(c, ctrl), c));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(stop));
+        if (mask) return p + first_bit(mask);
+    }
+    return skip_str_sse2(p, end);
+}
+
+UJSON_TARGET("avx2")
+static void classify_avx2(const char* p, uint64_t masks[4])
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab   = _mm256_set1_epi8('\t');
+    const __m256i cr    = _mm256_set1_epi8('\r');
+    const __m256i lf    = _mm256_set1_epi8('\n');
+    const __m256i div   = _mm256_set1_epi8('/');
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+    for (uint32_t i = 0; i < 64; i += 32) {
+        const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        const __m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, space), _mm256_cmpeq_epi8(c, tab)),
+                                              _mm256_or_si256(_mm256_cmpeq_epi8(c, cr), _mm256_cmpeq_epi8(c, lf)));
+        masks[0] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, quote)))) << i;
+        masks[1] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, slash)))) << i;
+        masks[2] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(blank))) << i;
+        masks[3] |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, div)))) << i;
+    }
+}
+
+// Each group of 8 bytes is shuffled by PSHUFB and stored whole, the next group overwrites the bytes not kept.
+UJSON_TARGET("avx2")
+static char* compress_avx2(const char* p, uint64_t keep, char* out)
+{
+    for (uint32_t i = 0; i < 64; i += 8, keep >>= 8) {
+        const uint32_t m = keep & 0xFF;
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i idx = _mm_cvtsi64_si128(static_cast<int64_t>(g_compress_table.idx[m]));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(bytes, idx));
+        out += g_compress_table.count[m];
+    }
+    return out;
+}
+
+UJSON_TARGET("avx512f,avx512bw")
+static const char* skip_blanks_avx512(const char* p, const char* end)
+{
+    const __m512i space = _mm512_set1_epi8(' ');
+    const __m512i tab   = _mm512_set1_epi8('\t');
+    for (; end - p >= 64; p += 64) {
+        const __m512i c = _mm512_loadu_si512(p);
+        const uint64_t mask = ~(_mm512_cmpeq_epi8_mask(c, space) | _mm512_cmpeq_epi8_mask(c, tab));
+        if (mask) return p + first_bit(mask);
+    }
+    return skip_blanks_avx2(p, end);
+}
+
+UJSON_TARGET("avx512f,avx512bw")
+static const char* skip_str_avx512(const char* p, const char* end)
+{
+    const __m512i quote = _mm512_set1_epi8('"');
+    const __m512i slash = _mm512_set1_epi8('\\');
+    const __m512i ctrl  = _mm512_set1_epi8(0x1F);
+    for (; end - p >= 64; p += 64) {
+        const __m512i c = _mm512_loadu_si512(p);
+        const uint64_t mask = _mm512_cmpeq_epi8_mask(c, quote) | _mm512_cmpeq_epi8_mask(c, slash) |
+            _mm512_cmple_epu8_mask(c, ctrl);
+        if (mask) return p + first_bit(mask);
+    }
+    return skip_str_avx2(p, end);
+}
+
+UJSON_TARGET("avx512f,avx512bw")
+static void classify_avx512(const char* p, uint64_t masks[4])
+{
+    const __m512i c = _mm512_loadu_si512(p);
+    masks[0] = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('"'));
+    masks[1] = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\\'));
+    masks[2] = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8(' ')) | _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\t')) |
+        _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\r')) | _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('\n'));
+    masks[3] = _mm512_cmpeq_epi8_mask(c, _mm512_set1_epi8('/'));
+}
+
+#endif // UJSON_X86
+
+static const Kernels g_kernels[] = {
+    { skip_blanks_scalar, skip_str_scalar, nullptr,         compress_scalar },
+#if defined(UJSON_X86)
+    { skip_blanks_sse2,   skip_str_sse2,   classify_sse2,   compress_scalar },
+    { skip_blanks_avx2,   skip_str_avx2,   classify_avx2,   compress_avx2   },
+    { skip_blanks_avx512, skip_str_avx512, classify_avx512, compress_avx2   },
+#endif
+};
+
+static SimdLevel detect_simd_level()
+{
+#if defined(UJSON_X86)
+#  if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    const int max_leaf = regs[0];
+    __cpuid(regs, 1);
+    const bool os_avx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)); // OSXSAVE, AVX
+    const uint64_t xcr0 = os_avx ? _xgetbv(0) : 0;
+    if (max_leaf >= 7 && (xcr0 & 0x06) == 0x06) {
+        __cpuidex(regs, 7, 0);
+        const bool avx512 = (regs[1] & (1 << 16)) && (regs[1] & (1 << 30)); // AVX512F, AVX512BW
+        if (avx512 && (xcr0 & 0xE6) == 0xE6) return slAvx512;
+        if (regs[1] & (1 << 5)) return slAvx2;
+    }
+    return slSse2;
+#  else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) return slAvx512;
+    if (__builtin_cpu_supports("avx2")) return slAvx2;
+    return slSse2;
+#  endif
+#else
+    return slScalar;
+#endif
+}
+
+static SimdLevel get_env_simd_level(SimdLevel level)
+{
+    const char* names[] = { "scalar", "sse2", "avx2", "avx512" };
+    std::string env;
+#if defined(_MSC_VER)
+    char* buf = nullptr;
+    if (0 == _dupenv_s(&buf, nullptr, "UJSON_SIMD") && buf) {
+        env = buf;
+        free(buf);
+    }
+#else
+    if (const char* buf = std::getenv("UJSON_SIMD"); buf) {
+        env = buf;
+    }
+#endif
+    for (int32_t i = 0; i <= level; i++) {
+        if (env == names[i]) return static_cast<SimdLevel>(i);
+    }
+    return level;
+}
+
+static const SimdLevel g_max_simd_level = detect_simd_level();
+static std::atomic<int32_t> g_simd_level{ get_env_simd_level(g_max_simd_level) };
+
+static const Kernels& get_kernels()
+{
+    return g_kernels[g_simd_level.load(std::memory_order_relaxed)];
+}
+
+class Parser
+{
+public:
+    Parser(char* str, const SchemaNode* schema = nullptr, const Limits& limits = Limits(), int32_t first_line = 1) :
+        m_begin{ str },
+        m_end{ str + strlen(str) },
+        m_next{ str },
+        m_line_count{ first_line },
+        m_kernels{ get_kernels() },
+        m_schema{ schema },
+        m_max{ limits }
+    {
+    }
+
+    ValImpl* parse()
+    {
+        try {
+            ValImpl* v = parse_val(nullptr, m_schema);
+            if (m_schema) {
+                m_schema->check(*v);
+            }
+            skip_white_space();
+            if (0 != *m_next) {
+                throw ErrSyntax("invalid value syntax", m_line_count);
+            }
+            return v;
+        }
+        catch (...) {
+            if (m_root) {
+                m_root->clear();
+                delete m_root;
+            }
+            throw;
+        }
+    }
+
+    // Parses the elements of a slice of the root array, found by ParallelParser.
+    // The slice ends with 0 written over a comma separating two elements or, if it is
+    // the last one, with the closing bracket of the root and the end of the input.
+    // Returns the position after the closing bracket, or nullptr if it is not the last slice.
+    char* parse_elements(ArrImpl* arr, bool last)
+    {
+        while (true) {
+            skip_white_space();
+            if (skip_text("]")) break;
+            m_pred = (arr->get_len() > 0) ? get_layout(arr->m_data.list->values.back()) : nullptr;
+            parse_val(arr);
+            skip_white_space();
+            if (!last && 0 == *m_next) return nullptr;
+            if (skip_text("]")) break;
+            if (!skip_text(",")) {
+                throw ErrSyntax("invalid array syntax: expected ',' or ']'", m_line_count);
+            }
+        }
+        char* end = m_next;
+        skip_white_space();
+        if (0 != *m_next || !last) { // the root is closed before the end of the input, see parse()
+            throw ErrSyntax("invalid value syntax", m_line_count);
+        }
+        return end;
+    }
+
+    int32_t get_line() const
+    {
+        return m_line_count;
+    }
+
+private:
+    
+    // The schema, if any, is used to validate the children of an array or object.
+    // The value itself is validated by the caller, once its name is known.
+    ValImpl* parse_val(ArrImpl* parent, const SchemaNode* schema = nullptr)
+    {
+        skip_white_space();
+        if (auto v = parse_val_null(parent); v) { return v; }
+        if (auto v = parse_val_bool(parent); v) { return v; }
+        if (auto v = parse_val_num (parent); v) { return v; }
+        if (auto v = parse_val_str (parent); v) { return v; }
+        if (auto v = parse_val_arr (parent, schema); v) { return v; }
+        if (auto v = parse_val_obj (parent, schema); v) { return v; }
+        throw ErrSyntax("invalid syntax", m_line_count);
+        return nullptr;
+    }
+
+    void raise_bad_utf()
+    {
+        throw ErrSyntax("invalid string syntax: bad utf-16 codepoint", m_line_count);
+    }
+
+    void raise_limit(const char* msg)
+    {
+        throw ErrLimit(msg, m_line_count);
+    }
+
+    ValImpl* add_val(ArrImpl* parent)
+    {
+        if (++m_node_count > m_max.nodes) {
+            raise_limit("limit exceeded: too many values");
+        }
+        ValImpl* v = (parent)?
+            &parent->add_element() :
+            (m_root = new ValImpl);
+        v->m_line_no = m_line_count;
+        return v;
+    }
+
+    void enter_container()
+    {
+        if (++m_depth > m_max.depth) {
+            raise_limit("limit exceeded: too deep nesting");
+        }
+    }
+
+    void check_entries(int32_t count)
+    {
+        if (count >= m_max.entries) {
+            raise_limit("limit exceeded: too many entries");
+        }
+    }
+
+    // Records the source range of a container, used by Json::reparse().
+    // While the container is parsed, 'src_pos' is absolute so that the children can be made relative to it.
+    void begin_src(ArrImpl* arr, const char* begin)
+    {
+        arr->m_data.list->src_pos = static_cast<size_t>(begin - m_begin);
+    }
+
+    void end_src(ArrImpl* arr, const ArrImpl* parent, int32_t first_line)
+    {
+        ValImpl::List& list = *arr->m_data.list;
+        list.src_len = static_cast<size_t>(m_next - m_begin) - list.src_pos;
+        list.src_lines = m_line_count - first_line;
+        if (parent) {
+            list.src_pos -= parent->m_data.list->src_pos;
+        }
+    }
+
+    // The layout of an object, if any, to predict the names of the next sibling.
+    static const ValImpl::Dict* get_layout(const ValImpl& v)
+    {
+        return (v.m_type & vtObj) ? static_cast<const ValImpl::Dict*>(v.m_data.list) : nullptr;
+    }
+
+    // The members of an object are usually named as the ones of the previous object at the same
+    // place, like the records of an array. While the names are the predicted ones, they are only
+    // compared to the text and not added to the table of the object: if all of them match,
+    // the table is copied from the predicted layout, otherwise they are added at the first
+    // mismatch. The layout predicted for a child object is the member at the same index.
+    ObjImpl* parse_val_obj(ArrImpl* parent, const SchemaNode* schema)
+    {
+        ObjImpl* obj = nullptr;
+        if (!skip_text("{")) return obj;
+        const ValImpl::Dict* pred = m_pred; // nullptr once a name differs
+        obj = &add_val(parent)->init_obj();
+        if (pred) {
+            obj->m_data.list->values.reserve(pred->values.size());
+        }
+        begin_src(obj, m_next - 1);
+        enter_container();
+        if (schema && 0 == (schema->types & vtObj)) schema = nullptr;
+        size_t required_count = 0;
+        while (true) {
+            skip_white_space();
+            if (skip_text("}")) break;
+            int32_t idx = obj->get_len();
+            check_entries(idx);
+            const char* name = pred ? parse_predicted_name(*pred, idx) : nullptr;
+            if (nullptr == name) {
+                if (pred) {
+                    obj->add_named_members(idx); // distinct, as in the predicted layout
+                    pred = nullptr;
+                }
+                name = parse_str();
+            }
+            if (nullptr == name) {
+                throw ErrSyntax("invalid object syntax: expected member name or '}'", m_line_count);
+            }
+            skip_white_space();
+            if (!skip_text(":")) {
+                throw ErrSyntax("invalid object syntax: expected ':' after member name", m_line_count);
+            }
+            skip_white_space();
+            const SchemaNode* member = schema ? schema->find_member(name) : nullptr;
+            m_pred = pred ? get_layout(pred->values[idx]) : nullptr;
+            ValImpl* v = parse_val(obj, member);
+            if (pred) {
+                v->m_name = name;
+            }
+            else if (!obj->add_member(name, idx, *v)) {
+                throw ErrSyntax("invalid object syntax: duplicate member name", m_line_count);
+            }
+            if (member) {
+                member->check(*v);
+                if (member->required) required_count++;
+            }
+            else if (schema && !schema->additional) {
+                throw ErrUnknownMember(*v);
+            }
+            skip_white_space();
+            if (skip_text("}")) break;
+            if (!skip_text(",")) {
+                throw ErrSyntax("invalid object syntax: expected ',' or '}'", m_line_count);
+            }
+        }
+        if (pred) {
+            if (obj->get_len() == static_cast<int32_t>(pred->values.size())) {
+                obj->copy_layout(*pred);
+            }
+            else {
+                obj->add_named_members(obj->get_len());
+            }
+        }
+        if (schema && required_count < schema->required_members.size()) {
+            schema->check_required(*obj);
+        }
+        end_src(obj, parent, obj->m_line_no);
+        m_depth--;
+        return obj;
+    }
+
+    ArrImpl* parse_val_arr(ArrImpl* parent, const SchemaNode* schema)
+    {
+        ArrImpl* arr = nullptr;
+        if (!skip_text("[")) return arr;
+        const char* begin = m_next - 1;
+        const SchemaNode* items = (schema && (schema->types & vtArr)) ? schema->items : nullptr;
+        ValImpl* v = add_val(parent);
+        enter_container();
+        if (ValImpl::Packed* packed = parse_packed(); packed) {
+            arr = &v->init_packed(packed);
+            begin_src(arr, begin);
+            end_src(arr, parent, arr->m_line_no);
+            if (items) {
+                items->check_packed(*arr);
+            }
+            m_depth--;
+            return arr;
+        }
+        arr = &v->init_arr();
+        begin_src(arr, begin);
+        while (true) {
+            skip_white_space();
+            if (skip_text("]")) break;
+            check_entries(arr->get_len());
+            m_pred = (arr->get_len() > 0) ? get_layout(arr->m_data.list->values.back()) : nullptr;
+            ValImpl* element = parse_val(arr, items);
+            if (items) {
+                items->check(*element);
+            }
+            skip_white_space();
+            if (skip_text("]")) break;
+            if (!skip_text(",")) {
+                throw ErrSyntax("invalid array syntax: expected ',' or ']'", m_line_count);
+            }
+        }
+        end_src(arr, parent, arr->m_line_no);
+        m_depth--;
+        return arr;
+    }
+
+    // Parses the array elements into a packed buffer if all of them are numbers.
+    // Otherwise returns nullptr and rewinds to the first element.
+    ValImpl::Packed* parse_packed()
+    {
+        char* const   start       = m_next;
+        const int32_t start_line  = m_line_count;
+        const int32_t start_nodes = m_node_count;
+        std::unique_ptr<ValImpl::Packed> packed(new ValImpl::Packed);
+        skip_white_space();
+        while (true) {
+            check_entries(packed->size());
+            int64_t i64 = 0;
+            double  f64 = 0.0;
+            const ValType type = scan_num(i64, f64);
+            if (vtNone == type || !packed->add(type, i64, f64)) break;
+            if (++m_node_count > m_max.nodes) {
+                raise_limit("limit exceeded: too many values");
+            }
+            skip_white_space();
+            if (skip_text("]")) return packed.release();
+            if (!skip_text(",")) {
+                throw ErrSyntax("invalid array syntax: expected ',' or ']'", m_line_count);
+            }
+            skip_white_space();
+            if (skip_text("]")) return packed.release();
+        }
+        m_next = start;
+        m_line_count = start_line;
+        m_node_count = start_nodes;
+        return nullptr;
+    }
+
+    ValImpl* parse_val_null(ArrImpl* parent)
+    {
+        ValImpl* v = nullptr;
+        if (skip_text("null")) {
+            v = add_val(parent);
+        }
+        return v;
+    }
+
+    ValImpl* parse_val_bool(ArrImpl* parent)
+    {
+        ValImpl* v = nullptr;
+        bool b = false;
+        if (skip_text("false")) {
+            b = false;
+        }
+        else if (skip_text("true")) {
+            b = true;
+        }
+        else {
+            return v;
+        }
+        v = add_val(parent);
+        v->init_bool(b);
+        return v;
+    }
+
+    ValImpl* parse_val_num(ArrImpl* parent)
+    {
+        ValImpl* v = nullptr;
+        int64_t i64 = 0;
+        double  f64 = 0.0;
+        switch (scan_num(i64, f64)) {
+        case vtInt:
+            v = add_val(parent);
+            v->init_int(i64);
+            break;
+        case vtF64:
+            v = add_val(parent);
+            v->init_f64(f64);
+            break;
+        default:
+            break;
+        }
+        return v;
+    }
+
+    // Returns vtInt or vtF64 and moves past the number, or vtNone if there is no number.
+    ValType scan_num(int64_t& i64, double& f64)
+    {
+        bool negative = false;
+        bool is_float = false;
+        char* p = m_next;
+        if ('-' == *p) {
+            negative = true;
+            p += 1;
+        }
+        char* num_start = p;
+        while (*p >= '0' && *p <= '9') p += 1;
+        if (p == m_next) return vtNone; // not a number as we didn't encounter ('-', '0'...'9')
+        if (p == num_start) {
+            throw ErrSyntax("invalid number syntax: no digits after '-'", m_line_count);
+        }
+        if ('0' == *num_start && (p - num_start) > 1) {
+            throw ErrSyntax("invalid number syntax: can't start with '0' if followed by another digit", m_line_count);
+        }
+        if ('.' == *p) {
+            is_float = true;
+            p += 1;
+            while (*p >= '0' && *p <= '9') p += 1;
+        }
+        if ('E' == *p || 'e' == *p) {
+            is_float = true;
+            p += 1;
+            if ('+' == *p || '-' == *p) p += 1;
+            while (*p >= '0' && *p <= '9') p += 1;
+        }
+        if (!is_float) {
+            // If integer exceeds -9223372036854775808 ... 9223372036854775807
+            // we should raise an error as it will not fit in 64 bits.
+            // Note this could be implemented via strtoll() and checking errno for ERANGE.
+            // 
+            // We test below that the absolute number will not exceed -a*10 + b
+            // For this, we work with a negative value of 'n',
+            // otherwise it may not fit the lower limit as a positive value.
+            //
+            const int64_t a = -922337203685477580;
+            const int b = negative ? 8 : 7;
+            int64_t n = 0;
+            p = num_start;
+            while (true) {
+                char c = *p;
+                if (c < '0' || c > '9') break;
+                int d = c - '0';
+                if (n < a || n == a && d > b) {
+                    throw ErrSyntax("invalid number syntax: integer doesn't fit in 64 bits", m_line_count);
+                }
+                n = n * 10 - d;
+                p += 1;
+            }
+            if (!negative) n = -n;
+            i64 = n;
+        }
+        else { // It is a float
+            char* end = m_next;
+            errno = 0;
+            double n = std::strtod(m_next, &end);
+            if (ERANGE == errno) {
+                throw ErrSyntax("invalid number syntax: float is too huge", m_line_count);
+            }
+            if (end != p) {
+                throw ErrSyntax("invalid number syntax: bad float format", m_line_count);
+            }
+            f64 = n;
+        }
+        m_next = p;
+        return is_float ? vtF64 : vtInt;
+    }
+
+    ValImpl* parse_val_str(ArrImpl* parent)
+    {
+        ValImpl* v = nullptr;
+        const char* str = parse_str();
+        if (nullptr != str) {
+            v = add_val(parent);
+            v->init_str(str);
+        }
+        return v;
+    }
+
+    // Returns the name if the text is the name at 'idx' in the predicted layout, as it would be
+    // returned by parse_str(). The names containing characters to escape are not predicted.
+    const char* parse_predicted_name(const ValImpl::Dict& pred, int32_t idx)
+    {
+        if (idx >= static_cast<int32_t>(pred.values.size()) || '"' != *m_next) return nullptr;
+        const char* expected = pred.values[idx].m_name;
+        char* p = m_next + 1;
+        while (*expected == *p && static_cast<unsigned char>(*p) >= ' ' && '"' != *p && '\\' != *p) {
+            expected++;
+            p++;
+        }
+        if (0 != *expected || '"' != *p) return nullptr;
+        char* name = m_next + 1;
+        *p = 0; // replace ending '"' with 0
+        m_next = p + 1;
+        return name;
+    }
+
+    const char* parse_str()
+    {
+        const char* str = nullptr;
+        if (!skip_text("\"")) return str;
+        char* str_end = m_next;
+        str = m_next;
+        while (true) {
+            char* run_end = const_cast<char*>(m_kernels.skip_str(m_next, m_end));
+            if (str_end != m_next) { // shift the characters after an escape sequence
+                memmove(str_end, m_next, run_end - m_next);
+            }
+            str_end += run_end - m_next;
+            m_next = run_end;
+            char c = *m_next++;
+            if ('"' == c) break;
+            if (c == '\r' || c == '\n' || c == 0) {
+                throw ErrSyntax("invalid string syntax: line ending before closing quotes", m_line_count);
+            }
+            if (static_cast<unsigned char>(c) < ' ') {
+                throw ErrSyntax("invalid string syntax: control characters not allowed", m_line_count);
+            }
+            if ('\\' == c) {
+                switch (*(m_next++))
+                {
+                case '"':  c = '"' ; break;
+                case '\\': c = '\\'; break;
+                case '/':  c = '/' ; break;
+                case 'b':  c = '\b'; break;
+                case 'f':  c = '\f'; break;
+                case 'n':  c = '\n'; break;
+                case 'r':  c = '\r'; break;
+                case 't':  c = '\t'; break;
+                case 'u':
+                    str_end = parse_encoding(str_end);
+                    continue;
+                default:
+                    m_next -= 1;
+                    throw ErrSyntax("invalid string syntax: bad escape character", m_line_count);
+                }
+            }
+            *str_end++ = c;
+        }
+        if (str_end - str > m_max.str_len) {
+            raise_limit("limit exceeded: too long string");
+        }
+        *str_end = 0; // replace ending '"' with 0
+        return str;
+    }
+
+    char* parse_encoding(char* str_end)
+    {
+        uint32_t code = parse_hex4();
+        if (code >= 0xDC00 && code <= 0xDFFF) {
+            raise_bad_utf(); // orphan low surrogate
+        }
+        if (code >= 0xD800 && code <= 0xDBFF) { // high surrogate
+            // Expect next \uXXXX escape with low surrogate
+            if (!skip_text("\\u")) {
+                raise_bad_utf(); // low surrogate not specified
+            }
+            uint32_t code2 = parse_hex4();
+            if (code2 < 0xDC00 || code2 > 0xDFFF) {
+                raise_bad_utf(); // invalid low surrogate
+            }
+            code = (((code - 0xD800) << 10) | (code2 - 0xDC00)) + 0x10000;
+        }
+        return encode_utf8(code, str_end);
+    }
+
+    uint32_t parse_hex4()
+    {
+        uint32_t code = 0;
+        char* p = m_next;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                c -= '0';
+            }
+            else if (c >= 'A' && c <= 'F') {
+                c -= 'A' - 10;
+            }
+            else if (c >= 'a' && c <= 'f') {
+                c -= 'a' - 10;
+            }
+            else {
+                raise_bad_utf(); // bad hex4 format
+            }
+            code += c;
+        }
+        m_next = p;
+        return code;
+    }
+
+    bool skip_text(const char* str)
+    {
+        size_t len = strlen(str);
+        if (0 != strncmp(m_next, str, len)) return false;
+        m_next += len;
+        return true;
+    }
+
+    void skip_white_space()
+    {
+        while (true) {
+            if (' ' == *m_next || '\t' == *m_next) {
+                m_next = const_cast<char*>(m_kernels.skip_blanks(m_next + 1, m_end));
+                continue;
+            }
+            if ('\r' == *m_next || '\n' == *m_next) {
+                skip_to_eol();
+                continue;
+            }
+            if ('/' == m_next[0] && '/' == m_next[1]) {
+                skip_to_eol();
+                continue;
+            }
+            break;
+        }
+    }
+
+    void skip_to_eol()
+    {
+        char* p = m_next;
+        while (true) {
+            const char c = *p;
+            if (0 == c) break;
+            p += 1;
+            if ('\r' == c) {
+                m_line_count++;
+                if ('\n' == *p) p += 1; // Windows style new-line (CR LF), otherwise old Mac (CR)
+                break;
+            }
+            if ('\n' == c) {            // Unix style new-line (LF)
+                m_line_count++;
+                break;
+            }
+        }
+        m_next = p;
+    }
+
+private:
+    char*   m_begin;
+    char*   m_end;
+    char*   m_next;
+    int32_t m_line_count;
+    const Kernels& m_kernels;
+    const SchemaNode* m_schema;
+    MaxLimits m_max;
+    int32_t   m_node_count = 0;
+    int32_t   m_depth = 0;
+    ValImpl*  m_root = nullptr; // deleted if parsing fails
+    const ValImpl::Dict* m_pred = nullptr; // layout predicted for the next object, see parse_val_obj()
+};
+
+// Parses a large root array of arrays or objects by several threads.
+//
+// A pre-scan finds commas separating the elements of the root array, roughly evenly spaced.
+// As JSON strings and comments can't contain line breaks, the pre-scan splits the input after
+// line breaks and scans the ranges in parallel twice: first to count the brackets and lines of
+// each range, then knowing the depth at its start, to select the commas at depth 1.
+// The slices between these commas are parsed by the threads into temporary arrays, which are
+// then moved into the root array. If a slice fails, the error of the first failing slice is the
+// one a sequential parse would report, since all the text before it is valid.
+class ParallelParser
+{
+public:
+    ParallelParser(char* str, int32_t threads) :
+        m_str{ str },
+        m_end{ str + strlen(str) },
+        m_threads{ threads }
+    {
+    }
+
+    // Returns nullptr, without modifying the input, if it is too small or not an array of arrays or objects.
+    ValImpl* parse()
+    {
+        const size_t min_slice_len = 256 * 1024;
+        const size_t len = static_cast<size_t>(m_end - m_str);
+        m_threads = static_cast<int32_t>(std::min<size_t>(m_threads, len / min_slice_len));
+        if (m_threads < 2 || !find_root()) return nullptr;
+        prescan();
+        if (m_commas.empty()) return nullptr;
+        return parse_slices();
+    }
+
+private:
+    struct Range {
+        const char* begin;
+        const char* end;
+        int32_t     depth = 0; // at the beginning
+        int32_t     line  = 0; // at the beginning
+        std::vector<std::pair<char*, int32_t>> commas; // selected commas and the line following them
+    };
+
+    bool find_root()
+    {
+        int32_t line = 1;
+        const char* p = skip_blanks(m_str, line);
+        if ('[' != *p) return false;
+        m_root_begin = const_cast<char*>(p);
+        m_root_line = line;
+        p = skip_blanks(p + 1, line);
+        return '[' == *p || '{' == *p;
+    }
+
+    const char* skip_blanks(const char* p, int32_t& line) const
+    {
+        while (p < m_end) {
+            if (' ' == *p || '\t' == *p) {
+                p++;
+            }
+            else if ('\n' == *p || '\r' == *p) {
+                p = skip_eol(p, line);
+            }
+            else if ('/' == p[0] && '/' == p[1]) {
+                while (p < m_end && '\n' != *p && '\r' != *p) p++;
+            }
+            else {
+                break;
+            }
+        }
+        return p;
+    }
+
+    const char* skip_eol(const char* p, int32_t& line) const // counts the line breaks as Parser::skip_to_eol()
+    {
+        line++;
+        if ('\r' == *p++ && p < m_end && '\n' == *p) p++;
+        return p;
+    }
+
+    // Calls on_comma(comma, depth, line) for each comma outside strings and comments.
+    template<class OnComma>
+    void scan(Range& range, int32_t& depth, int32_t& line, OnComma on_comma) const
+    {
+        const Kernels& kernels = get_kernels();
+        const char* p = range.begin;
+        while (p < range.end) {
+            const char c = *p;
+            switch (c) {
+            case '"':
+                p++;
+                while (true) {
+                    p = kernels.skip_str(p, range.end);
+                    if (p < range.end && '\\' == *p) {
+                        p += 2;
+                        continue;
+                    }
+                    if (p < range.end && '"' == *p) p++;
+                    break; // at the end of the string, or at a control character of invalid input
+                }
+                continue;
+            case '/':
+                if (p + 1 < range.end && '/' == p[1]) {
+                    while (p < range.end && '\n' != *p && '\r' != *p) p++;
+                    continue;
+                }
+                break;
+            case '[': case '{':
+                depth++;
+                break;
+            case ']': case '}':
+                depth--;
+                break;
+            case ',':
+                on_comma(const_cast<char*>(p), depth, line);
+                break;
+            case '\n': case '\r':
+                p = skip_eol(p, line);
+                continue;
+            default:
+                break;
+            }
+            p++;
+        }
+    }
+
+    void prescan()
+    {
+        // Split the input after line breaks, so that each range starts outside of strings and comments.
+        std::vector<Range> ranges;
+        const char* const first = m_root_begin + 1;
+        const char* begin = first;
+        const size_t step = static_cast<size_t>(m_end - first) / m_threads;
+        for (int32_t i = 1; i <= m_threads && begin < m_end; i++) {
+            const char* end = m_end;
+            if (i < m_threads) {
+                const char* target = std::max(begin, first + step * i);
+                const void* eol = memchr(target, '\n', m_end - target);
+                end = eol ? static_cast<const char*>(eol) + 1 : m_end;
+            }
+            Range range;
+            range.begin = begin;
+            range.end = end;
+            ranges.push_back(std::move(range));
+            begin = end;
+        }
+
+        // Pass 1: count the brackets and the lines of each range.
+        std::vector<std::pair<int32_t, int32_t>> deltas(ranges.size());
+        run(static_cast<int32_t>(ranges.size()), [&](int32_t i) {
+            int32_t depth = 0;
+            int32_t line = 0;
+            scan(ranges[i], depth, line, [](char*, int32_t, int32_t) {});
+            deltas[i] = { depth, line };
+        });
+        int32_t depth = 1;
+        int32_t line = m_root_line;
+        for (size_t i = 0; i < ranges.size(); i++) {
+            ranges[i].depth = depth;
+            ranges[i].line = line;
+            depth += deltas[i].first;
+            line += deltas[i].second;
+        }
+
+        // Pass 2: select the first comma at depth 1 after each multiple of the slice length.
+        const size_t slice_len = static_cast<size_t>(m_end - m_root_begin) / (m_threads * 4) + 1;
+        run(static_cast<int32_t>(ranges.size()), [&](int32_t i) {
+            Range& range = ranges[i];
+            const char* next = m_root_begin + ((range.begin - m_root_begin) / slice_len + 1) * slice_len;
+            int32_t d = range.depth;
+            int32_t l = range.line;
+            scan(range, d, l, [&](char* comma, int32_t comma_depth, int32_t comma_line) {
+                if (1 == comma_depth && comma >= next) {
+                    range.commas.emplace_back(comma, comma_line);
+                    next = m_root_begin + ((comma - m_root_begin) / slice_len + 1) * slice_len;
+                }
+            });
+        });
+        for (Range& range : ranges) {
+            m_commas.insert(m_commas.end(), range.commas.begin(), range.commas.end());
+        }
+    }
+
+    template<class Task>
+    void run(int32_t count, Task task)
+    {
+        std::atomic<int32_t> next{ 0 };
+        std::exception_ptr err;
+        std::mutex err_mutex;
+        auto worker = [&]() {
+            try {
+                for (int32_t i = next++; i < count; i = next++) {
+                    task(i);
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(err_mutex);
+                if (!err) err = std::current_exception();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int32_t i = 1; i < std::min(m_threads, count); i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (err) {
+            std::rethrow_exception(err);
+        }
+    }
+
+    ValImpl* parse_slices()
+    {
+        for (auto& comma : m_commas) {
+            *comma.first = 0;
+        }
+        const int32_t count = static_cast<int32_t>(m_commas.size()) + 1;
+        std::vector<ValImpl> slices(count);
+        std::vector<std::exception_ptr> errs(count);
+        char* root_end = nullptr;
+        int32_t root_last_line = 0;
+        run(count, [&](int32_t i) {
+            char* begin = (0 == i) ? m_root_begin + 1 : m_commas[i - 1].first + 1;
+            const int32_t line = (0 == i) ? m_root_line : m_commas[i - 1].second;
+            ArrImpl& arr = slices[i].init_arr();
+            // Make the source positions of the elements relative to the root, see Parser::end_src()
+            arr.m_data.list->src_pos = static_cast<size_t>(m_root_begin - begin);
+            try {
+                Parser parser(begin, nullptr, Limits(), line);
+                const bool last = (count - 1 == i);
+                char* end = parser.parse_elements(&arr, last);
+                if (last) {
+                    root_end = end;
+                    root_last_line = parser.get_line();
+                }
+            }
+            catch (...) {
+                errs[i] = std::current_exception();
+            }
+        });
+
+        ValImpl* root = nullptr;
+        try {
+            for (auto& err : errs) {
+                if (err) std::rethrow_exception(err);
+            }
+            root = new ValImpl;
+            root->m_line_no = m_root_line;
+            ArrImpl& arr = root->init_arr();
+            size_t len = 0;
+            for (const ValImpl& slice : slices) {
+                len += slice.m_data.list->values.size();
+            }
+            auto& values = arr.m_data.list->values;
+            values.reserve(len);
+            for (ValImpl& slice : slices) {
+                for (ValImpl& v : slice.m_data.list->values) {
+                    v.m_idx = static_cast<int32_t>(values.size());
+                    values.push_back(v);
+                }
+                slice.m_data.list->values.clear(); // moved to the root
+            }
+            arr.m_len = static_cast<int32_t>(len);
+            ValImpl::List& list = *arr.m_data.list;
+            list.src_pos = static_cast<size_t>(m_root_begin - m_str);
+            list.src_len = static_cast<size_t>(root_end - m_root_begin);
+            list.src_lines = root_last_line - m_root_line;
+        }
+        catch (...) {
+            if (root) {
+                root->clear();
+                delete root;
+            }
+            for (ValImpl& slice : slices) {
+                slice.clear();
+            }
+            throw;
+        }
+        for (ValImpl& slice : slices) {
+            slice.clear();
+        }
+        return root;
+    }
+
+    char*       m_str;
+    const char* m_end;
+    int32_t     m_threads;
+    char*       m_root_begin = nullptr;
+    int32_t     m_root_line = 1;
+    std::vector<std::pair<char*, int32_t>> m_commas; // separating the slices, and the line following them
+};
+
+// Checks the same grammar as Parser, without creating values or writing to the input.
+// The input doesn't need to be zero-terminated, an embedded 0 is treated as its end.
+class Validator
+{
+public:
+    Validator(const char* str, const char* end, const Limits& limits) :
+        m_next{ str },
+        m_end{ end },
+        m_line_count{ 1 },
+        m_kernels{ get_kernels() },
+        m_max{ limits }
+    {
+    }
+
+    void validate()
+    {
+        validate_val();
+        skip_white_space();
+        if (0 != peek()) {
+            throw ErrSyntax("invalid value syntax", m_line_count);
+        }
+    }
+
+private:
+
+    char at(const char* p) const
+    {
+        return (p < m_end) ? *p : 0;
+    }
+
+    char peek() const
+    {
+        return at(m_next);
+    }
+
+    void raise_limit(const char* msg)
+    {
+        throw ErrLimit(msg, m_line_count);
+    }
+
+    void validate_val()
+    {
+        skip_white_space();
+        if (skip_text("null"))     return add_node();
+        if (skip_text("false"))    return add_node();
+        if (skip_text("true"))     return add_node();
+        if (scan_num())            return add_node();
+        if (scan_str(nullptr))     return add_node();
+        if (validate_arr())        return;
+        if (validate_obj())        return;
+        throw ErrSyntax("invalid syntax", m_line_count);
+    }
+
+    void add_node() // counts the values as Parser::add_val() does
+    {
+        if (++m_node_count > m_max.nodes) {
+            raise_limit("limit exceeded: too many values");
+        }
+    }
+
+    void enter_container()
+    {
+        add_node();
+        if (++m_depth > m_max.depth) {
+            raise_limit("limit exceeded: too deep nesting");
+        }
+    }
+
+    void raise_bad_utf()
+    {
+        throw ErrSyntax("invalid string syntax: bad utf-16 codepoint", m_line_count);
+    }
+
+    bool validate_obj()
+    {
+        if (!skip_text("{")) return false;
+        enter_container();
+        const size_t names_begin = m_names.size();
+        std::unique_ptr<std::unordered_set<std::string_view>> name_set; // used by objects with many members
+        for (int32_t count = 0; ; count++) {
+            skip_white_space();
+            if (skip_text("}")) break;
+            if (count >= m_max.entries) {
+                raise_limit("limit exceeded: too many entries");
+            }
+            std::string_view name;
+            if (!scan_str(&name)) {
+                throw ErrSyntax("invalid object syntax: expected member name or '}'", m_line_count);
+            }
+            skip_white_space();
+            if (!skip_text(":")) {
+                throw ErrSyntax("invalid object syntax: expected ':' after member name", m_line_count);
+            }
+            skip_white_space();
+            validate_val();
+            if (!add_name(names_begin, name, name_set)) {
+                throw ErrSyntax("invalid object syntax: duplicate member name", m_line_count);
+            }
+            skip_white_space();
+            if (skip_text("}")) break;
+            if (!skip_text(",")) {
+                throw ErrSyntax("invalid object syntax: expected ',' or '}'", m_line_count);
+            }
+        }
+        m_names.resize(names_begin);
+        m_depth--;
+        return true;
+    }
+
+    // Returns false if the name was already added since 'names_begin'.
+    bool add_name(
+        size_t names_begin,
+        std::string_view name,
+        std::unique_ptr<std::unordered_set<std::string_view>>& name_set)
+    {
+        const size_t max_linear = 16;
+        if (name_set) {
+            return name_set->insert(name).second;
+        }
+        for (size_t i = names_begin; i < m_names.size(); i++) {
+            if (m_names[i] == name) return false;
+        }
+        m_names.push_back(name);
+        if (m_names.size() - names_begin > max_linear) {
+            name_set.reset(new std::unordered_set<std::string_view>(m_names.begin() + names_begin, m_names.end()));
+        }
+        return true;
+    }
+
+    bool validate_arr()
+    {
+        if (!skip_text("[")) return false;
+        enter_container();
+        for (int32_t count = 0; ; count++) {
+            skip_white_space();
+            if (skip_text("]")) break;
+            if (count >= m_max.entries) {
+                raise_limit("limit exceeded: too many entries");
+            }
+            validate_val();
+            skip_white_space();
+            if (skip_text("]")) break;
+            if (!skip_text(",")) {
+                throw ErrSyntax("invalid array syntax: expected ',' or ']'", m_line_count);
+            }
+        }
+        m_depth--;
+        return true;
+    }
+
+    bool scan_num()
+    {
+        bool negative = false;
+        bool is_float = false;
+        const char* p = m_next;
+        if ('-' == at(p)) {
+            negative = true;
+            p += 1;
+        }
+        const char* num_start = p;
+        while (at(p) >= '0' && at(p) <= '9') p += 1;
+        if (p == m_next) return false;
+        if (p == num_start) {
+            throw ErrSyntax("invalid number syntax: no digits after '-'", m_line_count);
+        }
+        if ('0' == *num_start && (p - num_start) > 1) {
+            throw ErrSyntax("invalid number syntax: can't start with '0' if followed by another digit", m_line_count);
+        }
+        if ('.' == at(p)) {
+            is_float = true;
+            p += 1;
+            while (at(p) >= '0' && at(p) <= '9') p += 1;
+        }
+        if ('E' == at(p) || 'e' == at(p)) {
+            is_float = true;
+            p += 1;
+            if ('+' == at(p) || '-' == at(p)) p += 1;
+            while (at(p) >= '0' && at(p) <= '9') p += 1;
+        }
+        if (!is_float) {
+            // Same range check as Parser::scan_num()
+            const int64_t a = -922337203685477580;
+            const int b = negative ? 8 : 7;
+            int64_t n = 0;
+            for (const char* d = num_start; d < p; d++) {
+                const int digit = *d - '0';
+                if (n < a || (n == a && digit > b)) {
+                    throw ErrSyntax("invalid number syntax: integer doesn't fit in 64 bits", m_line_count);
+                }
+                n = n * 10 - digit;
+            }
+        }
+        else {
+            // strtod() reads at most up to 'p', copy the number if 'p' is past the input.
+            std::string copy;
+            const char* num = m_next;
+            if (p >= m_end) {
+                copy.assign(m_next, p);
+                num = copy.c_str();
+            }
+            char* end = nullptr;
+            errno = 0;
+            std::ignore = std::strtod(num, &end);
+            if (ERANGE == errno) {
+                throw ErrSyntax("invalid number syntax: float is too huge", m_line_count);
+            }
+            if (end != num + (p - m_next)) {
+                throw ErrSyntax("invalid number syntax: bad float format", m_line_count);
+            }
+        }
+        m_next = p;
+        return true;
+    }
+
+    // If 'name' is not nullptr, it receives the unescaped string.
+    bool scan_str(std::string_view* name)
+    {
+        if (!skip_text("\"")) return false;
+        const char* str = m_next;
+        bool escaped = false;
+        int32_t len = 0; // after unescaping
+        while (true) {
+            const char* run_end = m_kernels.skip_str(m_next, m_end);
+            len += static_cast<int32_t>(run_end - m_next);
+            m_next = run_end;
+            const char c = peek();
+            m_next += 1;
+            if ('"' == c) break;
+            len += 1;
+            if (c == '\r' || c == '\n' || c == 0) {
+                throw ErrSyntax("invalid string syntax: line ending before closing quotes", m_line_count);
+            }
+            if (static_cast<unsigned char>(c) < ' ') {
+                throw ErrSyntax("invalid string syntax: control characters not allowed", m_line_count);
+            }
+            if ('\\' == c) {
+                escaped = true;
+                switch (peek())
+                {
+                case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                    m_next += 1;
+                    break;
+                case 'u': {
+                    m_next += 1;
+                    char buf[4];
+                    len += static_cast<int32_t>(encode_utf8(scan_encoding(), buf) - buf) - 1;
+                    break;
+                }
+                default:
+                    throw ErrSyntax("invalid string syntax: bad escape character", m_line_count);
+                }
+            }
+        }
+        if (len > m_max.str_len) {
+            raise_limit("limit exceeded: too long string");
+        }
+        if (nullptr != name) {
+            *name = escaped ?
+                unescape(str, m_next - 1) :
+                std::string_view(str, m_next - 1 - str);
+        }
+        return true;
+    }
+
+    uint32_t scan_encoding()
+    {
+        uint32_t code = scan_hex4();
+        if (code >= 0xDC00 && code <= 0xDFFF) {
+            raise_bad_utf(); // orphan low surrogate
+        }
+        if (code >= 0xD800 && code <= 0xDBFF) { // high surrogate
+            if (!skip_text("\\u")) {
+                raise_bad_utf(); // low surrogate not specified
+            }
+            uint32_t code2 = scan_hex4();
+            if (code2 < 0xDC00 || code2 > 0xDFFF) {
+                raise_bad_utf(); // invalid low surrogate
+            }
+            code = (((code - 0xD800) << 10) | (code2 - 0xDC00)) + 0x10000;
+        }
+        return code;
+    }
+
+    uint32_t scan_hex4()
+    {
+        uint32_t code = 0;
+        for (int i = 0; i < 4; i++) {
+            const char c = peek();
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                code += c - '0';
+            }
+            else if (c >= 'A' && c <= 'F') {
+                code += c - 'A' + 10;
+            }
+            else if (c >= 'a' && c <= 'f') {
+                code += c - 'a' + 10;
+            }
+            else {
+                raise_bad_utf(); // bad hex4 format
+            }
+            m_next += 1;
+        }
+        return code;
+    }
+
+    // Unescapes a validated member name, truncated at the first 0 as Parser names are.
+    std::string_view unescape(const char* str, const char* end)
+    {
+        std::string& out = m_unescaped.emplace_back();
+        const char* saved_next = m_next;
+        m_next = str;
+        while (m_next < end) {
+            char c = *m_next++;
+            if ('\\' == c) {
+                c = *m_next++;
+                switch (c)
+                {
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    char buf[4];
+                    out.append(buf, encode_utf8(scan_encoding(), buf));
+                    continue;
+                }
+                default: break;
+                }
+            }
+            out += c;
+        }
+        m_next = saved_next;
+        return std::string_view(out.c_str());
+    }
+
+    bool skip_text(const char* str)
+    {
+        const size_t len = strlen(str);
+        if (static_cast<size_t>(m_end - m_next) < len || 0 != memcmp(m_next, str, len)) return false;
+        m_next += len;
+        return true;
+    }
+
+    void skip_white_space()
+    {
+        while (true) {
+            const char c = peek();
+            if (' ' == c || '\t' == c) {
+                m_next = m_kernels.skip_blanks(m_next + 1, m_end);
+                continue;
+            }
+            if ('\r' == c || '\n' == c) {
+                skip_to_eol();
+                continue;
+            }
+            if ('/' == c && '/' == at(m_next + 1)) {
+                skip_to_eol();
+                continue;
+            }
+            break;
+        }
+    }
+
+    void skip_to_eol()
+    {
+        while (true) {
+            const char c = peek();
+            if (0 == c) break;
+            m_next += 1;
+            if ('\r' == c) {
+                m_line_count++;
+                if ('\n' == peek()) m_next += 1;
+                break;
+            }
+            if ('\n' == c) {
+                m_line_count++;
+                break;
+            }
+        }
+    }
+
+private:
+    const char* m_next;
+    const char* m_end;
+    int32_t     m_line_count;
+    const Kernels& m_kernels;
+    MaxLimits   m_max;
+    int32_t     m_node_count = 0;
+    int32_t     m_depth = 0;
+    std::vector<std::string_view> m_names;   // member names of the objects being validated
+    std::deque<std::string>       m_unescaped;
+};
+
+Err::Err(const char* msg, int32_t line_no) noexcept
+  : std::runtime_error(msg),
+    line(line_no)
+{
+}
+
+static std::string type_to_str(ValType t)
+{
+    const char* str = "";
+    switch (t) {
+    case vtNone: str = "none";  break;
+    case vtNull: str = "nul";   break;
+    case vtBool: str = "bool";  break;
+    case vtInt : str = "int";   break;
+    case vtF64 : str = "float"; break;
+    case vtStr:  str = "str";   break;
+    case vtArr:  str = "arr";   break;
+    case vtObj:  str = "obj";   break;
+    default:
+        return std::to_string(t);
+    }
+    return str;
+}
+
+std::string Err::get_err_str() const
+{
+    std::string str = "(" + std::to_string(line) + "): " + what() + '\n';
+    return str;
+}
+
+ErrValue::ErrValue(const char* msg, const Val& v) noexcept
+    : Err(msg, v.get_line()),
+      val_name(v.get_name()),
+      val_idx(v.get_idx()),
+      val_type(v.get_type())
+{
+}
+
+std::string ErrValue::get_err_str() const
+{
+    std::string str = Err::get_err_str();
+    if (val_name.size() > 0) {
+        str += "  value name: " + val_name + '\n';
+    }
+    else if (val_idx >= 0) {
+        str += "  value index: " + std::to_string(val_idx) + '\n';
+    }
+    if (val_type != vtNone) {
+        str += "  val_type: " + type_to_str(val_type) + '\n';
+    }
+    return str;
+}
+
+ErrBadType::ErrBadType(const Val& v, ValType expected) noexcept
+    : ErrValue("bad type", v),
+    expected_type(expected)
+{
+}
+
+std::string ErrBadType::get_err_str() const
+{
+    std::string str = ErrValue::get_err_str();
+    if (expected_type != vtNone) {
+        str += "  expected_type: " + type_to_str(expected_type) + '\n';
+    }
+    return str;
+}
+
+ErrBadIntRange::ErrBadIntRange(const Val& v, int64_t _lo, int64_t _hi) noexcept
+    : ErrValue("bad integer range", v),
+      lo(_lo),
+      hi(_hi)
+{
+}
+
+std::string ErrBadIntRange::get_err_str() const
+{
+    std::string str = ErrValue::get_err_str();
+    if (lo <= hi) {
+        str += "  expected range: " + std::to_string(lo) + " ... " + std::to_string(hi) + '\n';
+    }
+    return str;
+}
+
+ErrBadF64Range::ErrBadF64Range(const Val& v, double _lo, double _hi) noexcept
+    : ErrValue("bad float range", v),
+      lo(_lo),
+      hi(_hi)
+{
+}
+
+std::string ErrBadF64Range::get_err_str() const
+{
+    std::string str = ErrValue::get_err_str();
+    if (lo <= hi) {
+        str += "  expected range: " + std::to_string(lo) + " ... " + std::to_string(hi) + '\n';
+    }
+    return str;
+}
+
+ErrBadLen::ErrBadLen(const Val& v, int32_t _lo, int32_t _hi) noexcept
+    : ErrValue("bad length", v),
+      lo(_lo),
+      hi(_hi)
+{
+}
+
+std::string ErrBadLen::get_err_str() const
+{
+    std::string str = ErrValue::get_err_str();
+    str += "  expected length: " + std::to_string(lo) + " ... " + std::to_string(hi) + '\n';
+    return str;
+}
+
+ErrMemberNotFound::ErrMemberNotFound(const Obj& v, const char* name) noexcept
+    : ErrValue("member not found", v)
+{
+    val_name = name;
+    val_idx = -1;
+    val_type = vtNone;
+}
+
+ErrMemberNotFound::ErrMemberNotFound(const Arr& v, int32_t idx) noexcept
+    : ErrValue("element not found", v)
+{
+    val_name.clear();
+    val_idx = idx;
+    val_type = vtNone;
+}
+
+ErrUnknownMember::ErrUnknownMember(const Val& v) noexcept
+    : ErrValue("unknown member", v)
+{
+}
+
+ErrBadEnum::ErrBadEnum(const Val& v) noexcept
+    : ErrValue("unsupported value", v)
+{
+}
+
+void Json::clear() noexcept
+{
+    free_root();
+    free_buf();
+    m_len = 0;
+    m_slices.clear();
+    m_slices_len = 0;
+}
+
+void Json::free_root() noexcept
+{
+    if (nullptr != m_root) {
+        auto* v = &ValImpl::from(m_root);
+        v->clear();
+        delete v;
+        m_root = nullptr;
+    }
+}
+
+void Json::free_buf() noexcept
+{
+    delete[] m_buf;
+    m_buf = nullptr;
+}
+
+const Val& Json::parse(const char* str, size_t len)
+{
+    clear();
+    if (0 == len) {
+        len = strlen(str);
+    }
+    check_max_bytes(len, m_limits);
+    m_buf = new char[len + 1];
+    memcpy(m_buf, str, len);
+    m_buf[len] = 0;
+    parse_in_place(m_buf);
+    m_len = len;
+    return *m_root;
+}
+
+const Val& Json::parse_in_place(char* str)
+{
+    free_root();
+    m_len = 0;
+    m_slices.clear();
+    m_slices_len = 0;
+    if (m_limits.max_bytes > 0 && str != m_buf) {
+        const void* end = memchr(str, 0, m_limits.max_bytes + 1);
+        check_max_bytes(end ? static_cast<const char*>(end) - str : m_limits.max_bytes + 1, m_limits);
+    }
+    if (m_threads > 1 && nullptr == m_schema && !limits_values(m_limits)) {
+        ParallelParser pp(str, m_threads);
+        m_root = pp.parse();
+        if (m_root) return *m_root;
+    }
+    Parser p(str, (m_schema && m_schema->m_impl) ? m_schema->m_impl->root() : nullptr, m_limits);
+    m_root = p.parse();
+    return *m_root;
+}
+
+const Val& Json::parse(const Reader& reader)
+{
+    clear();
+    const size_t block_size = 1 << 16;
+    size_t cap = block_size;
+    size_t len = 0;
+    std::unique_ptr<char[]> buf(new char[cap + 1]);
+    while (size_t n = reader(buf.get() + len, cap - len)) {
+        len += n;
+        check_max_bytes(len, m_limits);
+        if (len == cap) {
+            std::unique_ptr<char[]> next(new char[cap * 2 + 1]);
+            memcpy(next.get(), buf.get(), len);
+            buf = std::move(next);
+            cap *= 2;
+        }
+    }
+    buf[len] = 0;
+    m_buf = buf.release();
+    parse_in_place(m_buf);
+    m_len = len;
+    return *m_root;
+}
+
+size_t Json::parse_ndjson(const Reader& reader, const std::function<void(const Val& root)>& callback)
+{
+    clear();
+    const size_t block_size = 1 << 16;
+    size_t cap = block_size;
+    size_t len = 0;    // bytes in buf
+    size_t line = 0;   // start of the current line in buf
+    size_t next = 0;   // where to search the end of the current line
+    int32_t line_no = 1;
+    size_t count = 0;
+    std::unique_ptr<char[]> buf(new char[cap + 1]);
+    const SchemaNode* schema = (m_schema && m_schema->m_impl) ? m_schema->m_impl->root() : nullptr;
+    bool eof = false;
+
+    auto parse_line = [&](char* str) {
+        for (const char* c = str; *c; c++) {
+            if (' ' != *c && '\t' != *c && '\r' != *c) {
+                Parser p(str, schema, m_limits, line_no);
+                m_root = p.parse();
+                try {
+                    callback(*m_root);
+                }
+                catch (...) {
+                    free_root();
+                    throw;
+                }
+                free_root();
+                count++;
+                return;
             }
-            code += c;
         }
-        m_next = p;
-        return code;
+    };
+
+    while (!eof || line < len) {
+        char* end = static_cast<char*>(memchr(buf.get() + next, '\n', len - next));
+        if (end || (eof && line < len)) {
+            const size_t end_pos = end ? end - buf.get() : len;
+            if (m_limits.max_bytes > 0 && end_pos - line > m_limits.max_bytes) {
+                throw ErrLimit("limit exceeded: input is too long", line_no);
+            }
+            buf[end_pos] = 0;
+            parse_line(buf.get() + line);
+            line = next = end_pos + 1;
+            line_no++;
+            continue;
+        }
+        next = len;
+        if (m_limits.max_bytes > 0 && len - line > m_limits.max_bytes) {
+            throw ErrLimit("limit exceeded: input is too long", line_no);
+        }
+        if (line > 0) { // keep the incomplete line only
+            memmove(buf.get(), buf.get() + line, len - line);
+            len -= line;
+            next -= line;
+            line = 0;
+        }
+        if (cap - len < block_size / 2) { // a long line
+            std::unique_ptr<char[]> grown(new char[cap * 2 + 1]);
+            memcpy(grown.get(), buf.get(), len);
+            buf = std::move(grown);
+            cap *= 2;
+        }
+        const size_t n = reader(buf.get() + len, cap - len);
+        len += n;
+        eof = (0 == n);
+    }
+    return count;
+}
+
+// Returns the index of the child array or object of 'list' whose brackets enclose the bytes [begin, end),
+// or -1 if there is none. 'base' is the absolute offset of 'list'.
+static int32_t find_enclosing(const ValImpl::List& list, size_t base, size_t begin, size_t end)
+{
+    auto is_container = [](const ValImpl& v) { return 0 != (v.get_type() & (vtArr | vtObj)); };
+    const auto& values = list.values;
+    int32_t lo = 0;
+    int32_t hi = static_cast<int32_t>(values.size());
+    while (lo < hi) { // binary search, skipping the scalars as they have no source range
+        const int32_t mid = lo + (hi - lo) / 2;
+        int32_t i = mid;
+        while (i < hi && !is_container(values[i])) i++;
+        if (i == hi) {
+            hi = mid;
+            continue;
+        }
+        const ValImpl::List& child = *values[i].m_data.list;
+        const size_t child_begin = base + child.src_pos;
+        if (begin <= child_begin) {
+            hi = mid;
+        }
+        else if (begin >= child_begin + child.src_len) {
+            lo = i + 1;
+        }
+        else {
+            return (end < child_begin + child.src_len) ? i : -1;
+        }
+    }
+    return -1;
+}
+
+static void shift_lines(ValImpl& v, int32_t delta)
+{
+    v.m_line_no += delta;
+    if (v.get_type() & (vtArr | vtObj)) {
+        for (ValImpl& child : v.m_data.list->values) {
+            shift_lines(child, delta);
+        }
+    }
+}
+
+bool Json::reparse_container(const char* str, size_t len, size_t pos, size_t old_len, size_t new_len)
+{
+    if (0 == m_len || m_len - old_len + new_len != len || pos + old_len > m_len ||
+        m_schema || m_limits.max_bytes || limits_values(m_limits))
+    {
+        return false;
+    }
+    ValImpl* root = &ValImpl::from(m_root);
+    if (0 == (root->get_type() & (vtArr | vtObj))) return false;
+
+    // Find the smallest container enclosing the edit, excluding the root.
+    struct Level {
+        ValImpl* v;
+        size_t   base;
+        int32_t  idx;
+    };
+    std::vector<Level> path;
+    ValImpl* v = root;
+    size_t base = root->m_data.list->src_pos;
+    while (v->get_type() & (vtArr | vtObj)) {
+        const int32_t idx = find_enclosing(*v->m_data.list, base, pos, pos + old_len);
+        if (idx < 0) break;
+        path.push_back({ v, base, idx });
+        v = &v->m_data.list->values[idx];
+        base += v->m_data.list->src_pos;
+    }
+    if (path.empty()) return false;
+
+    const ValImpl::List& old_list = *v->m_data.list;
+    const ptrdiff_t delta = static_cast<ptrdiff_t>(new_len) - static_cast<ptrdiff_t>(old_len);
+    const size_t slice_len = old_list.src_len + delta;
+    if (m_slices_len + slice_len > len) return false; // parse all to release the slices
+    std::unique_ptr<char[]> slice(new char[slice_len + 1]);
+    memcpy(slice.get(), str + base, slice_len);
+    slice[slice_len] = 0;
+    ValImpl* sub = nullptr;
+    try {
+        Parser p(slice.get(), nullptr, Limits(), v->m_line_no);
+        sub = p.parse();
+    }
+    catch (const Err&) {
+        return false; // the error is reported by a full parse
+    }
+    const int32_t line_delta = sub->m_data.list->src_lines - old_list.src_lines;
+    sub->m_data.list->src_pos = old_list.src_pos;
+
+    // Replace the container, keeping its name and index.
+    const char*   name = v->m_name;
+    const int32_t idx = v->m_idx;
+    v->clear();
+    *v = *sub;
+    v->m_name = name;
+    v->m_idx = idx;
+    delete sub;
+    m_slices.push_back(std::move(slice));
+    m_slices_len += slice_len;
+    m_len = len;
+
+    // Shift the containers and lines following the edit. The source positions are relative
+    // to the parent, so only the ancestors and their following siblings are updated.
+    for (const Level& level : path) {
+        ValImpl::List& list = *level.v->m_data.list;
+        list.src_len += delta;
+        list.src_lines += line_delta;
+        list.hash.store(0, std::memory_order_relaxed);
+        for (size_t i = level.idx + 1; i < list.values.size(); i++) {
+            ValImpl& next = list.values[i];
+            if (next.get_type() & (vtArr | vtObj)) {
+                next.m_data.list->src_pos += delta;
+            }
+            if (line_delta) {
+                shift_lines(next, line_delta);
+            }
+        }
+    }
+    return true;
+}
+
+const Val& Json::reparse(const char* str, size_t len, size_t pos, size_t old_len, size_t new_len)
+{
+    if (m_root && reparse_container(str, len, pos, old_len, new_len)) {
+        return *m_root;
+    }
+    return parse(str, len);
+}
+
+static size_t get_mem_usage(const ValImpl& v)
+{
+    if (0 == (v.get_type() & (vtArr | vtObj))) return 0;
+    const ValImpl::List& list = *v.m_data.list;
+    size_t bytes = list.values.capacity() * sizeof(ValImpl);
+    for (const ValImpl& child : list.values) {
+        bytes += get_mem_usage(child);
+    }
+    if (v.get_type() & vtObj) {
+        const auto& slots = static_cast<const ValImpl::Dict&>(list).slots;
+        bytes += sizeof(ValImpl::Dict) + slots.capacity() * sizeof(ValImpl::Dict::Slot);
+    }
+    else if (v.get_type() & vtPackedBit) {
+        const auto& packed = static_cast<const ValImpl::Packed&>(list);
+        bytes += sizeof(ValImpl::Packed) + packed.i64.capacity() * sizeof(int64_t) +
+            packed.f64.capacity() * sizeof(double) + packed.f64_int.capacity() / 8;
+    }
+    else {
+        bytes += sizeof(ValImpl::List);
+    }
+    return bytes;
+}
+
+size_t Json::get_mem_usage() const noexcept
+{
+    size_t bytes = m_len + 1 + m_slices_len;
+    if (m_root) {
+        bytes += sizeof(ValImpl) + ujson::get_mem_usage(ValImpl::from(m_root));
+    }
+    return bytes;
+}
+
+SimdLevel get_simd_level() noexcept
+{
+    return static_cast<SimdLevel>(g_simd_level.load());
+}
+
+SimdLevel set_simd_level(SimdLevel level) noexcept
+{
+    if (level < slScalar) level = slScalar;
+    if (level > g_max_simd_level) level = g_max_simd_level;
+    g_simd_level = level;
+    return level;
+}
+
+void validate(const char* str, size_t len, const Limits& limits)
+{
+    if (0 == len) {
+        len = strlen(str);
+    }
+    check_max_bytes(len, limits);
+    Validator v(str, str + len, limits);
+    v.validate();
+}
+
+// Marks the characters following an odd number of backslashes, which may continue from the previous block.
+static uint64_t find_escaped(uint64_t backslash, uint64_t& next_escaped)
+{
+    const uint64_t odd_bits = 0xAAAAAAAAAAAAAAAAULL;
+    const uint64_t escape_start = backslash & ~next_escaped;
+    const uint64_t codes = (((escape_start << 1) | odd_bits) - escape_start) ^ odd_bits;
+    const uint64_t escaped = codes ^ (backslash | next_escaped);
+    next_escaped = (codes & backslash) >> 63;
+    return escaped;
+}
+
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+struct MinifyState
+{
+    uint64_t in_str = 0;  // all bits set if the previous block ended inside a string
+    uint64_t escaped = 0; // 1 if its last character is an unescaped backslash
+};
+
+// Removes the blanks outside of the strings of whole blocks of 64 bytes. Stops before the last partial
+// block or at a '/' outside of the strings, leaving the comments to minify().
+static void minify_blocks(const Kernels& kernels, const char*& p, const char* end, char*& out, MinifyState& state)
+{
+    uint64_t masks[4];
+    if (nullptr == kernels.classify) return;
+    for (; end - p >= 64; p += 64) {
+        kernels.classify(p, masks);
+        const uint64_t quote = masks[0] & ~find_escaped(masks[1], state.escaped);
+        const uint64_t in_str = prefix_xor(quote) ^ state.in_str;
+        const uint64_t keep = ~(masks[2] & ~in_str);
+        const uint64_t slash = masks[3] & ~in_str;
+        if (slash) {
+            const uint64_t before = (uint64_t(1) << first_bit(slash)) - 1;
+            for (uint64_t m = keep & before; m; m &= m - 1) { // exactly the kept bytes, as the rest is still to read
+                *out++ = p[first_bit(m)];
+            }
+            p += first_bit(slash);
+            state = MinifyState();
+            return;
+        }
+        state.in_str = static_cast<uint64_t>(static_cast<int64_t>(in_str) >> 63);
+        if (~uint64_t(0) == keep) {
+            if (out != p) {
+                memmove(out, p, 64);
+            }
+            out += 64;
+        }
+        else {
+            out = kernels.compress(p, keep, out);
+        }
+    }
+}
+
+static const char* skip_plain(const char* p, const char* end) // stops at a blank, a line break, '"' or '/'
+{
+    while (p < end) {
+        const char c = *p;
+        if (' ' == c || '\t' == c || '\r' == c || '\n' == c || '"' == c || '/' == c) break;
+        p++;
+    }
+    return p;
+}
+
+// The blocks are classified by SIMD masks and compressed. The rest is copied by runs.
+size_t minify(const char* str, size_t len, char* out)
+{
+    if (0 == len) {
+        len = strlen(str);
+    }
+    const Kernels& kernels = get_kernels();
+    const char* p = str;
+    const char* end = str + len;
+    char* o = out;
+    MinifyState state;
+    auto keep = [&](const char* q) {
+        if (o != p) {
+            memmove(o, p, q - p);
+        }
+        o += q - p;
+        p = q;
+    };
+    auto keep_str = [&]() { // after the opening quote
+        while (p < end) {
+            keep(kernels.skip_str(p, end));
+            if (p == end) break;
+            if ('"' == *p) {
+                keep(p + 1);
+                break;
+            }
+            keep(std::min(p + (('\\' == *p) ? 2 : 1), end));
+        }
+    };
+    while (true) {
+        minify_blocks(kernels, p, end, o, state);
+        if (state.in_str) { // the end of a string is in the last partial block
+            if (state.escaped) {
+                keep(p + 1);
+            }
+            keep_str();
+        }
+        state = MinifyState();
+        keep(skip_plain(p, end));
+        if (p == end) break;
+        const char c = *p;
+        if (' ' == c || '\t' == c) {
+            p = kernels.skip_blanks(p + 1, end);
+        }
+        else if ('\r' == c || '\n' == c) {
+            p++;
+        }
+        else if ('/' == c) {
+            if (p + 1 < end && '/' == p[1]) {
+                while (p < end && '\r' != *p && '\n' != *p) p++;
+            }
+            else {
+                keep(p + 1);
+            }
+        }
+        else {
+            keep(p + 1);
+            keep_str();
+        }
+    }
+    *o = 0;
+    return o - out;
+}
+
+size_t minify(char* str, size_t len)
+{
+    return minify(str, len, str);
+}
+
+// The elements of a packed array are not created, they are copied into 'tmp' as by materialize().
+static const ValImpl& get_element(const ValImpl& arr, int32_t idx, ValImpl& tmp)
+{
+    if (0 == (arr.m_type & vtPackedBit)) return arr.m_data.list->values[idx];
+    const auto& packed = static_cast<const ValImpl::Packed&>(*arr.m_data.list);
+    if (!packed.i64.empty()) {
+        tmp.init_int(packed.i64[idx]);
+    }
+    else if (packed.f64_int[idx]) {
+        tmp.init_int(static_cast<int64_t>(packed.f64[idx]));
+    }
+    else {
+        tmp.init_f64(packed.f64[idx]);
+    }
+    return tmp;
+}
+
+static uint64_t mix_hash(uint64_t h) // finalizer of MurmurHash3
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB93E4A65EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// A float with an integer value is handled as the integer, so that 1 equals 1.0 as in RFC 6902.
+static bool get_int_value(const ValImpl& v, int64_t& i64)
+{
+    if (vtInt == v.get_type()) {
+        i64 = v.m_data.i64;
+        return true;
+    }
+    const double f = v.m_data.f64;
+    if (f >= -9223372036854775808.0 && f < 9223372036854775808.0 && f == std::floor(f)) {
+        i64 = static_cast<int64_t>(f);
+        return true;
+    }
+    return false;
+}
+
+static uint64_t hash_val(const ValImpl& v);
+
+static uint64_t hash_list(const ValImpl& v)
+{
+    const ValImpl::List& list = *v.m_data.list;
+    uint64_t h = list.hash.load(std::memory_order_relaxed);
+    if (0 != h) return h;
+    const int32_t len = v.m_len;
+    if (vtObj == v.get_type()) { // the sum doesn't depend on the order of the members
+        h = 7;
+        for (const ValImpl& member : list.values) {
+            h += mix_hash(hash_name(member.m_name) * 31 + hash_val(member));
+        }
+    }
+    else {
+        h = 6;
+        ValImpl tmp;
+        for (int32_t i = 0; i < len; i++) {
+            h = h * 1099511628211ULL + hash_val(get_element(v, i, tmp));
+        }
+    }
+    h = mix_hash(h ^ static_cast<uint64_t>(len));
+    h += (0 == h); // 0 means not computed
+    list.hash.store(h, std::memory_order_relaxed);
+    return h;
+}
+
+static uint64_t hash_val(const ValImpl& v)
+{
+    int64_t i64 = 0;
+    switch (v.get_type()) {
+    case vtNull:
+        return mix_hash(1);
+    case vtBool:
+        return mix_hash(v.m_data.b ? 3 : 2);
+    case vtInt:
+    case vtF64:
+        if (get_int_value(v, i64)) return mix_hash(static_cast<uint64_t>(i64) ^ 4);
+        return mix_hash(std::hash<double>()(v.m_data.f64) ^ 5);
+    case vtStr:
+        return mix_hash(hash_name(v.m_data.str));
+    case vtArr:
+    case vtObj:
+        return hash_list(v);
+    default:
+        return 0;
+    }
+}
+
+uint64_t hash_val(const Val& v) noexcept
+{
+    return hash_val(ValImpl::from(&v));
+}
+
+static bool same_val(const ValImpl& a, const ValImpl& b)
+{
+    if (&a == &b) return true;
+    const ValType type = a.get_type();
+    if ((type | b.get_type()) == (vtInt | vtF64)) {
+        int64_t i = 0;
+        int64_t j = 0;
+        return get_int_value(a, i) && get_int_value(b, j) && i == j;
+    }
+    if (type != b.get_type()) return false;
+    switch (type) {
+    case vtBool:
+        return a.m_data.b == b.m_data.b;
+    case vtInt:
+        return a.m_data.i64 == b.m_data.i64;
+    case vtF64:
+        return a.m_data.f64 == b.m_data.f64;
+    case vtStr:
+        return 0 == strcmp(a.m_data.str, b.m_data.str);
+    case vtArr:
+    case vtObj:
+        break;
+    default:
+        return true;
+    }
+    if (a.m_len != b.m_len || hash_list(a) != hash_list(b)) return false;
+    if (vtObj == type) {
+        const ObjImpl& obj = *reinterpret_cast<const ObjImpl*>(&b);
+        for (const ValImpl& member : a.m_data.list->values) {
+            const int32_t idx = obj.find(member.m_name);
+            if (idx < 0 || !same_val(member, b.m_data.list->values[idx])) return false;
+        }
+        return true;
+    }
+    ValImpl tmp_a;
+    ValImpl tmp_b;
+    for (int32_t i = 0; i < a.m_len; i++) {
+        if (!same_val(get_element(a, i, tmp_a), get_element(b, i, tmp_b))) return false;
+    }
+    return true;
+}
+
+bool equals(const Val& a, const Val& b) noexcept
+{
+    return same_val(ValImpl::from(&a), ValImpl::from(&b));
+}
+
+static void write_str(std::string& out, const char* str)
+{
+    out += '"';
+    for (const char* p = str; *p; p++) {
+        const unsigned char c = static_cast<unsigned char>(*p);
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else {
+                out += static_cast<char>(c);
+            }
+        }
+    }
+    out += '"';
+}
+
+static void write_val(std::string& out, const ValImpl& v)
+{
+    char buf[32];
+    switch (v.get_type()) {
+    case vtBool:
+        out += v.m_data.b ? "true" : "false";
+        break;
+    case vtInt:
+        out += std::to_string(v.m_data.i64);
+        break;
+    case vtF64:
+        snprintf(buf, sizeof(buf), "%.17g", v.m_data.f64);
+        out += buf;
+        break;
+    case vtStr:
+        write_str(out, v.m_data.str);
+        break;
+    case vtArr: {
+        out += '[';
+        ValImpl tmp;
+        for (int32_t i = 0; i < v.m_len; i++) {
+            if (i) out += ',';
+            write_val(out, get_element(v, i, tmp));
+        }
+        out += ']';
+        break;
+    }
+    case vtObj: {
+        out += '{';
+        for (const ValImpl& member : v.m_data.list->values) {
+            if (&member != &v.m_data.list->values[0]) out += ',';
+            write_str(out, member.m_name);
+            out += ':';
+            write_val(out, member);
+        }
+        out += '}';
+        break;
+    }
+    default:
+        out += "null";
+    }
+}
+
+static void add_patch_op(std::string& out, const char* op, const std::string& path, const ValImpl* v)
+{
+    out += (out.size() > 1) ? ",{\"op\":\"" : "{\"op\":\"";
+    out += op;
+    out += "\",\"path\":";
+    write_str(out, path.c_str());
+    if (v) {
+        out += ",\"value\":";
+        write_val(out, *v);
+    }
+    out += '}';
+}
+
+static void add_path_token(std::string& path, const char* name) // RFC 6901 escapes
+{
+    path += '/';
+    for (const char* p = name; *p; p++) {
+        if ('~' == *p) path += "~0";
+        else if ('/' == *p) path += "~1";
+        else path += *p;
+    }
+}
+
+// Descends only in the values whose hashes differ. The elements of arrays are compared
+// by index, the elements added or removed are at the end.
+static void diff_val(const ValImpl& a, const ValImpl& b, std::string& path, std::string& out)
+{
+    if (same_val(a, b)) return;
+    const ValType type = a.get_type();
+    const size_t path_len = path.size();
+    if (vtObj == type && vtObj == b.get_type()) {
+        const ObjImpl& obj_a = *reinterpret_cast<const ObjImpl*>(&a);
+        const ObjImpl& obj_b = *reinterpret_cast<const ObjImpl*>(&b);
+        for (const ValImpl& member : a.m_data.list->values) {
+            add_path_token(path, member.m_name);
+            const int32_t idx = obj_b.find(member.m_name);
+            if (idx < 0) {
+                add_patch_op(out, "remove", path, nullptr);
+            }
+            else {
+                diff_val(member, b.m_data.list->values[idx], path, out);
+            }
+            path.resize(path_len);
+        }
+        for (const ValImpl& member : b.m_data.list->values) {
+            if (obj_a.find(member.m_name) >= 0) continue;
+            add_path_token(path, member.m_name);
+            add_patch_op(out, "add", path, &member);
+            path.resize(path_len);
+        }
+    }
+    else if (vtArr == type && vtArr == b.get_type()) {
+        ValImpl tmp_a;
+        ValImpl tmp_b;
+        const int32_t common = std::min(a.m_len, b.m_len);
+        for (int32_t i = 0; i < common; i++) {
+            add_path_token(path, std::to_string(i).c_str());
+            diff_val(get_element(a, i, tmp_a), get_element(b, i, tmp_b), path, out);
+            path.resize(path_len);
+        }
+        for (int32_t i = common; i < b.m_len; i++) {
+            add_path_token(path, std::to_string(i).c_str());
+            add_patch_op(out, "add", path, &get_element(b, i, tmp_b));
+            path.resize(path_len);
+        }
+        for (int32_t i = a.m_len - 1; i >= common; i--) { // from the end, so that the indexes are still valid
+            add_path_token(path, std::to_string(i).c_str());
+            add_patch_op(out, "remove", path, nullptr);
+            path.resize(path_len);
+        }
+    }
+    else {
+        add_patch_op(out, "replace", path, &b);
+    }
+}
+
+std::string diff(const Val& from, const Val& to)
+{
+    std::string path;
+    std::string out = "[";
+    diff_val(ValImpl::from(&from), ValImpl::from(&to), path, out);
+    out += ']';
+    return out;
+}
+
+void Schema::compile(const char* str, size_t len)
+{
+    clear();
+    m_impl = new SchemaImpl;
+    try {
+        m_impl->compile(str, len);
+    }
+    catch (...) {
+        clear();
+        throw;
+    }
+}
+
+void Schema::clear() noexcept
+{
+    delete m_impl;
+    m_impl = nullptr;
+}
+
+static std::unique_ptr<char[]> read_file(const char* path, size_t& len)
+{
+    std::FILE* f = std::fopen(path, "rb");
+    if (nullptr == f) {
+        throw Err("can't open file", 0);
+    }
+    std::unique_ptr<char[]> buf;
+    if (0 == std::fseek(f, 0, SEEK_END)) {
+        const long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+        if (size >= 0) {
+            len = static_cast<size_t>(size);
+            buf.reset(new char[len + 1]);
+            len = std::fread(buf.get(), 1, len, f);
+            buf[len] = 0;
+        }
+    }
+    std::fclose(f);
+    if (!buf) {
+        throw Err("can't read file", 0);
+    }
+    return buf;
+}
+
+// The documents are published by a simple RCU scheme. Readers register in the
+// counter of the current epoch. The writer swaps the document, moves to the next
+// epoch and retires the previous document, which is freed once the counter of its
+// epoch drops to zero. The writer doesn't wait for the readers: the retired
+// documents are checked after each load and at each poll of the watch thread.
+// A counter is shared by every other epoch, so a document retired while readers of
+// a later epoch of the same parity are active is freed once they leave as well.
+struct LiveDoc::Impl
+{
+    struct Doc {
+        std::unique_ptr<char[]> buf;
+        Json json;
+        const Val* root = nullptr;
+    };
+
+    struct Retired {
+        Doc*     doc;
+        uint32_t epoch; // the last one in which it was current
+    };
+
+    void load()
+    {
+        std::unique_ptr<Doc> doc(new Doc);
+        size_t len = 0;
+        doc->buf = read_file(path.c_str(), len);
+        doc->root = &doc->json.parse_in_place(doc->buf.get());
+        if (validate) {
+            validate(*doc->root);
+        }
+        freeze(&ValImpl::from(doc->root));
+        Doc* old = current.exchange(doc.release());
+        const uint32_t e = epoch.fetch_add(1);
+        if (old) {
+            retired.push_back({ old, e });
+        }
+        free_retired();
     }
 
-    bool skip_text(const char* str)
+    void free_retired() // under reload_mutex, or before the watch thread starts
     {
-        size_t len = strlen(str);
-        if (0 != strncmp(m_next, str, len)) return false;
-        m_next += len;
-        return true;
+        auto end = std::remove_if(retired.begin(), retired.end(), [this](const Retired& r) {
+            if (readers[r.epoch & 1].load() != 0) return false;
+            delete r.doc;
+            return true;
+        });
+        retired.erase(end, retired.end());
     }
 
-    void skip_white_space()
+    void poll_retired()
     {
-        while (true) {
-            if (' ' == *m_next || '\t' == *m_next) {
-                m_next += 1;
-                continue;
-            }
-            if ('\r' == *m_next || '\n' == *m_next) {
-                skip_to_eol();
-                continue;
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        free_retired();
+    }
+
+    void watch()
+    {
+#if defined(__linux__)
+        if (watch_inotify()) return;
+#endif
+        watch_mtime();
+    }
+
+#if defined(__linux__)
+    bool watch_inotify()
+    {
+        const std::filesystem::path p(path);
+        const std::string dir = p.has_parent_path() ? p.parent_path().string() : ".";
+        const std::string name = p.filename().string();
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) return false;
+        // Watch the directory, as editors often replace the file instead of writing it.
+        if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            close(fd);
+            return false;
+        }
+        alignas(inotify_event) char events[4096];
+        while (!stop) {
+            poll_retired();
+            pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, poll_ms) <= 0) continue;
+            bool changed = false;
+            ssize_t len;
+            while ((len = read(fd, events, sizeof(events))) > 0) {
+                for (char* p = events; p < events + len; ) {
+                    const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+                    if (ev->len > 0 && name == ev->name) changed = true;
+                    p += sizeof(inotify_event) + ev->len;
+                }
             }
-            if ('/' == m_next[0] && '/' == m_next[1]) {
-                skip_to_eol();
-                continue;
+            if (changed) {
+                std::ignore = owner->reload();
             }
-            break;
         }
+        close(fd);
+        return true;
     }
+#endif
 
-    void skip_to_eol()
+    void watch_mtime()
     {
-        char* p = m_next;
-        while (true) {
-            const char c = *p;
-            if (0 == c) break;
-            p += 1;
-            if ('\r' == c) {
-                m_line_count++;
-                if ('\n' == *p) p += 1; // Windows style new-line (CR LF), otherwise old Mac (CR)
-                break;
-            }
-            if ('\n' == c) {            // Unix style new-line (LF)
-                m_line_count++;
-                break;
+        std::error_code err;
+        auto last = std::filesystem::last_write_time(path, err);
+        while (!stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(poll_ms));
+            poll_retired();
+            const auto time = std::filesystem::last_write_time(path, err);
+            if (!err && time != last) {
+                last = time;
+                std::ignore = owner->reload();
             }
         }
-        m_next = p;
     }
 
-private:
-    char*   m_next;
-    int32_t m_line_count;
+    LiveDoc*             owner = nullptr;
+    std::string          path;
+    Validate             validate;
+    int32_t              poll_ms = 0;
+    std::atomic<Doc*>    current{ nullptr };
+    std::atomic<uint32_t> epoch{ 0 };
+    std::atomic<int32_t> readers[2] = { {0}, {0} };
+    std::vector<Retired> retired;      // previous documents that may still be read
+    std::mutex           reload_mutex; // serializes the writers and 'retired' only
+    std::string          last_err;
+    std::atomic<bool>    stop{ false };
+    std::thread          thread;
 };
 
-Err::Err(const char* msg, int32_t line_no) noexcept
-  : std::runtime_error(msg),
-    line(line_no)
+LiveDoc::LiveDoc(const char* path, Validate validate, int32_t poll_ms) :
+    m_impl{ new Impl }
 {
+    m_impl->owner = this;
+    m_impl->path = path;
+    m_impl->validate = std::move(validate);
+    m_impl->poll_ms = poll_ms;
+    m_impl->load();
+    m_impl->thread = std::thread(&Impl::watch, m_impl.get());
 }
 
-static std::string type_to_str(ValType t)
+LiveDoc::~LiveDoc() noexcept
 {
-    const char* str = "";
-    switch (t) {
-    case vtNone: str = "none";  break;
-    case vtNull: str = "nul";   break;
-    case vtBool: str = "bool";  break;
-    case vtInt : str = "int";   break;
-    case vtF64 : str = "float"; break;
-    case vtStr:  str = "str";   break;
-    case vtArr:  str = "arr";   break;
-    case vtObj:  str = "obj";   break;
-    default:
-        return std::to_string(t);
+    m_impl->stop = true;
+    m_impl->thread.join();
+    delete m_impl->current.load();
+    for (const auto& r : m_impl->retired) { // no snapshot outlives LiveDoc
+        delete r.doc;
     }
-    return str;
-}
-
-std::string Err::get_err_str() const
-{
-    std::string str = "(" + std::to_string(line) + "): " + what() + '\n';
-    return str;
 }
 
-ErrValue::ErrValue(const char* msg, const Val& v) noexcept
-    : Err(msg, v.get_line()),
-      val_name(v.get_name()),
-      val_idx(v.get_idx()),
-      val_type(v.get_type())
+LiveDoc::Snapshot LiveDoc::get() const noexcept
 {
+    Impl& d = *m_impl;
+    while (true) {
+        const uint32_t e = d.epoch.load();
+        std::atomic<int32_t>& readers = d.readers[e & 1];
+        readers.fetch_add(1);
+        if (d.epoch.load() == e) {
+            return Snapshot(d.current.load()->root, &readers);
+        }
+        readers.fetch_sub(1); // the writer moved to the next epoch meanwhile
+    }
 }
 
-std::string ErrValue::get_err_str() const
+bool LiveDoc::reload()
 {
-    std::string str = Err::get_err_str();
-    if (val_name.size() > 0) {
-        str += "  value name: " + val_name + '\n';
+    std::lock_guard<std::mutex> lock(m_impl->reload_mutex);
+    try {
+        m_impl->load();
+        m_impl->last_err.clear();
+        return true;
     }
-    else if (val_idx >= 0) {
-        str += "  value index: " + std::to_string(val_idx) + '\n';
+    catch (const Err& e) {
+        m_impl->last_err = e.get_err_str();
     }
-    if (val_type != vtNone) {
-        str += "  val_type: " + type_to_str(val_type) + '\n';
+    catch (const std::exception& e) {
+        m_impl->last_err = e.what();
     }
-    return str;
+    return false;
 }
 
-ErrBadType::ErrBadType(const Val& v, ValType expected) noexcept
-    : ErrValue("bad type", v),
-    expected_type(expected)
+std::string LiveDoc::get_last_err() const
 {
+    std::lock_guard<std::mutex> lock(m_impl->reload_mutex);
+    return m_impl->last_err;
 }
 
-std::string ErrBadType::get_err_str() const
+void Path::compile(const char* path)
 {
-    std::string str = ErrValue::get_err_str();
-    if (expected_type != vtNone) {
-        str += "  expected_type: " + type_to_str(expected_type) + '\n';
+    m_steps.clear();
+    const char* p = path;
+    while (*p) {
+        Step step;
+        if ('[' == *p) {
+            const char* digits = ++p;
+            int64_t idx = 0;
+            while (*p >= '0' && *p <= '9' && idx <= INT32_MAX) {
+                idx = idx * 10 + (*p++ - '0');
+            }
+            if (p == digits || ']' != *p || idx > INT32_MAX) {
+                throw Err("invalid path syntax: expected index and ']'", 0);
+            }
+            step.idx = static_cast<int32_t>(idx);
+            p++;
+        }
+        else {
+            if (!m_steps.empty()) {
+                if ('.' != *p) {
+                    throw Err("invalid path syntax: expected '.' or '['", 0);
+                }
+                p++;
+            }
+            const char* name = p;
+            while (*p && '.' != *p && '[' != *p) p++;
+            if (p == name) {
+                throw Err("invalid path syntax: empty member name", 0);
+            }
+            step.name.assign(name, p);
+            step.hash = slot_hash(hash_name(step.name.c_str()));
+        }
+        m_steps.push_back(std::move(step));
     }
-    return str;
 }
 
-ErrBadIntRange::ErrBadIntRange(const Val& v, int64_t _lo, int64_t _hi) noexcept
-    : ErrValue("bad integer range", v),
-      lo(_lo),
-      hi(_hi)
+const Val* Path::eval(const Val& root, bool required) const
 {
+    const ValImpl* v = &ValImpl::from(&root);
+    for (const Step& step : m_steps) {
+        const bool is_idx = step.name.empty();
+        if (0 == (v->m_type & (is_idx ? vtArr : vtObj))) {
+            if (!required) return nullptr;
+            throw ErrBadType(*v, is_idx ? vtArr : vtObj);
+        }
+        const ArrImpl& arr = *static_cast<const ArrImpl*>(v);
+        int32_t idx = step.idx;
+        if (!is_idx) {
+            idx = static_cast<const ObjImpl&>(arr).find(step.name.c_str(), step.hash);
+            if (idx < 0) {
+                if (required) throw ErrMemberNotFound(static_cast<const ObjImpl&>(arr).as_obj(), step.name.c_str());
+                return nullptr;
+            }
+        }
+        else if (idx >= arr.get_len()) {
+            if (required) throw ErrMemberNotFound(*static_cast<const Arr*>(static_cast<const Val*>(v)), idx);
+            return nullptr;
+        }
+        if (arr.is_packed()) arr.materialize();
+        v = &arr.m_data.list->values[idx];
+        v->mark_as_used();
+    }
+    return v;
 }
 
-std::string ErrBadIntRange::get_err_str() const
+bool Path::get_bool(const Val& root) const
 {
-    std::string str = ErrValue::get_err_str();
-    if (lo <= hi) {
-        str += "  expected range: " + std::to_string(lo) + " ... " + std::to_string(hi) + '\n';
-    }
-    return str;
+    return eval(root)->as_bool().get();
 }
 
-ErrBadF64Range::ErrBadF64Range(const Val& v, double _lo, double _hi) noexcept
-    : ErrValue("bad float range", v),
-      lo(_lo),
-      hi(_hi)
+int32_t Path::get_i32(const Val& root, int32_t lo, int32_t hi) const
 {
+    return eval(root)->as_int().get_i32(lo, hi);
 }
 
-std::string ErrBadF64Range::get_err_str() const
+int64_t Path::get_i64(const Val& root, int64_t lo, int64_t hi) const
 {
-    std::string str = ErrValue::get_err_str();
-    if (lo <= hi) {
-        str += "  expected range: " + std::to_string(lo) + " ... " + std::to_string(hi) + '\n';
-    }
-    return str;
+    return eval(root)->as_int().get(lo, hi);
 }
 
-ErrMemberNotFound::ErrMemberNotFound(const Obj& v, const char* name) noexcept
-    : ErrValue("member not found", v)
+double Path::get_f64(const Val& root, double lo, double hi) const
 {
-    val_name = name;
-    val_idx = -1;
-    val_type = vtNone;
+    return eval(root)->as_f64().get(lo, hi);
 }
 
-ErrUnknownMember::ErrUnknownMember(const Val& v) noexcept
-    : ErrValue("unknown member", v)
+const char* Path::get_str(const Val& root) const
 {
+    return eval(root)->as_str().get();
 }
 
-ErrBadEnum::ErrBadEnum(const Val& v) noexcept
-    : ErrValue("unsupported value", v)
+const Arr& Path::get_arr(const Val& root) const
 {
+    return eval(root)->as_arr();
 }
 
-void Json::clear() noexcept
+const Obj& Path::get_obj(const Val& root) const
 {
-    free_root();
-    free_buf();
+    return eval(root)->as_obj();
 }
 
-void Json::free_root() noexcept
+static uint64_t hash_bytes(const char* str, size_t len)
 {
-    if (nullptr != m_root) {
-        auto* v = &ValImpl::from(m_root);
-        v->clear();
-        delete v;
-        m_root = nullptr;
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = len * k;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, str + i, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 29;
     }
+    uint64_t w = 0;
+    memcpy(&w, str + i, len - i);
+    h = (h ^ w) * k;
+    return h ^ (h >> 32);
 }
 
-void Json::free_buf() noexcept
+// The documents are kept in a list ordered from the most to the least recently used.
+// The input text is kept to compare it on a hit, so that a hash collision can't return another document.
+struct DocCache::Impl
 {
-    delete[] m_buf;
-    m_buf = nullptr;
+    struct Entry {
+        uint64_t                    hash;
+        std::string                 text;
+        std::shared_ptr<const Json> json;
+        size_t                      bytes;
+    };
+    using Lru = std::list<Entry>;
+
+    struct Key {
+        uint64_t hash;
+        size_t   len;
+        bool operator == (const Key& other) const { return hash == other.hash && len == other.len; }
+    };
+    struct KeyHash {
+        size_t operator () (const Key& key) const { return static_cast<size_t>(key.hash); }
+    };
+
+    std::shared_ptr<const Json> find(const Key& key, const char* str)
+    {
+        auto iter = map.find(key);
+        if (iter == map.end()) return nullptr;
+        Lru::iterator entry = iter->second;
+        if (0 != memcmp(entry->text.data(), str, key.len)) return nullptr;
+        lru.splice(lru.begin(), lru, entry);
+        return entry->json;
+    }
+
+    void add(const Key& key, const char* str, const std::shared_ptr<const Json>& json)
+    {
+        const size_t bytes = key.len + json->get_mem_usage();
+        if (bytes > max_bytes) return;
+        if (auto iter = map.find(key); iter != map.end()) { // added by another thread meanwhile, or collision
+            remove(iter->second);
+        }
+        lru.push_front({ key.hash, std::string(str, key.len), json, bytes });
+        map.emplace(key, lru.begin());
+        stats.bytes += bytes;
+        stats.docs++;
+        while (stats.bytes > max_bytes) {
+            remove(std::prev(lru.end()));
+            stats.evictions++;
+        }
+    }
+
+    void remove(Lru::iterator entry)
+    {
+        map.erase({ entry->hash, entry->text.size() });
+        stats.bytes -= entry->bytes;
+        stats.docs--;
+        lru.erase(entry);
+    }
+
+    size_t     max_bytes = 0;
+    std::mutex mutex;
+    Lru        lru;
+    std::unordered_map<Key, Lru::iterator, KeyHash> map;
+    Stats      stats;
+};
+
+DocCache::DocCache(size_t max_bytes) :
+    m_impl{ new Impl }
+{
+    m_impl->max_bytes = max_bytes;
 }
 
-const Val& Json::parse(const char* str, size_t len)
+DocCache::~DocCache() noexcept = default;
+
+std::shared_ptr<const Json> DocCache::parse(const char* str, size_t len)
 {
-    clear();
     if (0 == len) {
         len = strlen(str);
     }
-    m_buf = new char[len + 1];
-    strncpy_s(m_buf, len + 1, str, len);
-    m_buf[len] = 0;
-    return parse_in_place(m_buf);
+    const Impl::Key key{ hash_bytes(str, len), len };
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mutex);
+        if (auto json = m_impl->find(key, str); json) {
+            m_impl->stats.hits++;
+            return json;
+        }
+        m_impl->stats.misses++;
+    }
+    // Parse without the lock, so that other threads can use the cache meanwhile.
+    auto json = std::make_shared<Json>();
+    json->parse(str, len);
+    freeze(&ValImpl::from(json->get_root()));
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->add(key, str, json);
+    return json;
 }
 
-const Val& Json::parse_in_place(char* str)
+DocCache::Stats DocCache::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    return m_impl->stats;
+}
+
+void DocCache::clear() noexcept
+{
+    std::lock_guard<std::mutex> lock(m_impl->mutex);
+    m_impl->map.clear();
+    m_impl->lru.clear();
+    m_impl->stats.bytes = 0;
+    m_impl->stats.docs = 0;
+}
+
+BatchLoader::BatchLoader(int32_t readers, int32_t parsers, size_t max_bytes) :
+    m_readers{ std::max(readers, 1) },
+    m_parsers{ (parsers > 0) ? parsers : std::max(static_cast<int32_t>(std::thread::hardware_concurrency()), 1) },
+    m_max_bytes{ max_bytes }
+{
+}
+
+// The readers take the files in order and queue their content, waiting while the queued
+// bytes exceed the budget. The parsers take the content from the queue and call the callback.
+BatchLoader::Stats BatchLoader::load(const std::vector<std::string>& paths, const Callback& callback) const
+{
+    struct File {
+        size_t                  idx;
+        std::unique_ptr<char[]> buf;
+        size_t                  len;
+        std::exception_ptr      err;
+    };
+    std::mutex              mutex;
+    std::condition_variable can_read;
+    std::condition_variable can_parse;
+    std::deque<File>        queue;
+    size_t                  queued_bytes = 0;
+    int32_t                 readers_left = m_readers;
+    std::atomic<size_t>     next{ 0 };
+    std::atomic<bool>       stop{ false };
+    std::exception_ptr      callback_err;
+    Stats                   stats;
+
+    auto reader = [&]() {
+        for (size_t i = next++; i < paths.size() && !stop; i = next++) {
+            File file{ i, nullptr, 0, nullptr };
+            std::error_code ec;
+            const auto fs_size = std::filesystem::file_size(paths[i], ec);
+            const size_t size = ec ? 0 : static_cast<size_t>(fs_size);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // A file over the budget is read only when no other file is reserved, queued or parsed,
+                // so that the readers don't take several of them at once.
+                can_read.wait(lock, [&] { return stop || 0 == queued_bytes || queued_bytes + size <= m_max_bytes; });
+                queued_bytes += size; // reserved before reading
+            }
+            try {
+                file.buf = read_file(paths[i].c_str(), file.len);
+            }
+            catch (...) {
+                file.err = std::current_exception();
+            }
+            file.len = file.buf ? file.len : 0;
+            std::lock_guard<std::mutex> lock(mutex);
+            queued_bytes += file.len;
+            queued_bytes -= size;
+            queue.push_back(std::move(file));
+            can_parse.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (0 == --readers_left) {
+            can_parse.notify_all();
+        }
+    };
+
+    auto parser = [&]() {
+        Json json;
+        while (true) {
+            File file;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                can_parse.wait(lock, [&] { return !queue.empty() || 0 == readers_left; });
+                if (queue.empty()) return;
+                file = std::move(queue.front());
+                queue.pop_front();
+            }
+            bool failed = false;
+            try {
+                try {
+                    if (file.err) {
+                        std::rethrow_exception(file.err);
+                    }
+                    const Val& root = json.parse_in_place(file.buf.get());
+                    if (!stop) callback(file.idx, paths[file.idx].c_str(), &root, nullptr);
+                }
+                catch (const Err& e) {
+                    failed = true;
+                    if (!stop) callback(file.idx, paths[file.idx].c_str(), nullptr, &e);
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!callback_err) callback_err = std::current_exception();
+                stop = true;
+            }
+            json.clear();
+            file.buf.reset();
+            std::lock_guard<std::mutex> lock(mutex);
+            queued_bytes -= file.len;
+            stats.files++;
+            stats.errors += failed ? 1 : 0;
+            stats.bytes += file.len;
+            can_read.notify_all();
+        }
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < m_readers; i++) {
+        threads.emplace_back(reader);
+    }
+    for (int32_t i = 0; i < m_parsers; i++) {
+        threads.emplace_back(parser);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (callback_err) {
+        std::rethrow_exception(callback_err);
+    }
+    return stats;
+}
+
+const Val& StaticDoc::get_root() const
+{
+    std::call_once(m_once, [this]() {
+        auto json = std::make_unique<Json>();
+        json->parse(m_literal.c_str(), m_literal.size());
+        m_json = std::move(json);
+    });
+    return *m_json->get_root();
+}
+
+#if defined(UJSON_ZLIB)
+// The thread fills a block while the other one is read by the caller.
+struct GzipReader::Impl
+{
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t                  len = 0;
+        size_t                  pos = 0;
+        bool                    full = false;
+    };
+
+    Impl(const char* path, size_t block_size) :
+        m_file{ gzopen(path, "rb") },
+        m_block_size{ std::max<size_t>(block_size, 1024) }
+    {
+        if (nullptr == m_file) {
+            throw Err("can't open file", 0);
+        }
+        gzbuffer(m_file, static_cast<unsigned>(std::min<size_t>(m_block_size, 1 << 20)));
+        for (auto& block : m_blocks) {
+            block.data.reset(new char[m_block_size]);
+        }
+        m_thread = std::thread(&Impl::run, this);
+    }
+
+    ~Impl() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_can_fill.notify_all();
+        m_thread.join();
+        gzclose(m_file);
+    }
+
+    void run() noexcept
+    {
+        for (size_t i = 0; ; i ^= 1) {
+            Block& block = m_blocks[i];
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_can_fill.wait(lock, [&] { return m_stop || !block.full; });
+                if (m_stop) return;
+            }
+            const int n = gzread(m_file, block.data.get(), static_cast<unsigned>(m_block_size));
+            int code = Z_OK;
+            const char* msg = (n <= 0) ? gzerror(m_file, &code) : nullptr;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (n < 0 || (0 == n && Z_OK != code)) { // Z_BUF_ERROR if the file is truncated
+                m_err = (Z_BUF_ERROR == code) ? "unexpected end of gzip file" : msg;
+                m_done = true;
+            }
+            else {
+                block.len = static_cast<size_t>(n);
+                block.pos = 0;
+                block.full = (n > 0);
+                m_done = (0 == n);
+            }
+            m_can_read.notify_one();
+            if (m_done) return;
+        }
+    }
+
+    size_t read(char* buf, size_t size)
+    {
+        size_t total = 0;
+        while (total < size) {
+            Block& block = m_blocks[m_read_idx];
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_can_read.wait(lock, [&] { return block.full || m_done; });
+                if (!block.full) {
+                    if (!m_err.empty()) {
+                        throw Err(m_err.c_str(), 0);
+                    }
+                    break;
+                }
+            }
+            const size_t n = std::min(size - total, block.len - block.pos);
+            memcpy(buf + total, block.data.get() + block.pos, n);
+            block.pos += n;
+            total += n;
+            if (block.pos == block.len) {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    block.full = false;
+                }
+                m_can_fill.notify_one();
+                m_read_idx ^= 1;
+            }
+        }
+        return total;
+    }
+
+    gzFile                  m_file;
+    const size_t            m_block_size;
+    std::array<Block, 2>    m_blocks;
+    size_t                  m_read_idx = 0;
+    std::mutex              m_mutex;
+    std::condition_variable m_can_fill;
+    std::condition_variable m_can_read;
+    bool                    m_stop = false;
+    bool                    m_done = false;
+    std::string             m_err;
+    std::thread             m_thread;
+};
+
+GzipReader::GzipReader(const char* path, size_t block_size) :
+    m_impl{ std::make_shared<Impl>(path, block_size) }
 {
-    free_root();
-    Parser p(str);
-    m_root = p.parse();
-    return *m_root;
 }
 
+size_t GzipReader::operator () (char* buf, size_t size) const
+{
+    return m_impl->read(buf, size);
+}
+#endif
+
 }; // namespace ujson
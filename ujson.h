@@ -4,6 +4,11 @@
 #include <stdexcept>
 #include <string>
 #include <array>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 
 namespace ujson {
 
@@ -19,6 +24,18 @@ enum ValType: uint32_t
     vtObj  = 1 << 6
 };
 
+const uint32_t vtUsedBit   = 1U << 31; // bit in Val::m_type indicating that the value was accessed by the application
+const uint32_t vtPackedBit = 1U << 30; // bit in Val::m_type indicating that the array elements are stored in a packed buffer
+const uint32_t vtFlagBits  = vtUsedBit | vtPackedBit;
+
+enum SimdLevel: int32_t // instruction sets used to scan the input
+{
+    slScalar = 0,
+    slSse2   = 1,
+    slAvx2   = 2,
+    slAvx512 = 3  // AVX-512BW
+};
+
 class Val;
 class Bool;
 class Int;
@@ -26,6 +43,22 @@ class F64;
 class Str;
 class Arr;
 class Obj;
+class Schema;
+class SchemaImpl;
+struct Column;
+class ArrIndex;
+struct Err;
+
+using Reader = std::function<size_t(char* buf, size_t size)>; // reads up to size bytes of the input, returns 0 at its end
+
+struct Limits // bounds the resources used to parse untrusted input, 0 means unlimited
+{
+    size_t  max_bytes   = 0; // input length
+    int32_t max_nodes   = 0; // values, including the elements of packed arrays
+    int32_t max_depth   = 0; // nesting of arrays and objects
+    int32_t max_str_len = 0; // length of a string or member name, after unescaping
+    int32_t max_entries = 0; // elements of an array or members of an object
+};
 
 class Json
 {
@@ -38,23 +71,73 @@ public:
     Json& operator = (Json&&) = delete;
     const Val& parse(const char* str, size_t len = 0); // str must be zero-terminated if len=0
     const Val& parse_in_place(char* str); // str must be zero-terminated and allocated until Json instance is destroyed
+    const Val& parse(const Reader& reader); // reads the whole input, then parses it
+    // Parses NDJSON read in blocks, one document per line, blank lines skipped. The callback is called
+    // for each document, whose values are released when it returns. Returns the number of documents.
+    size_t parse_ndjson(const Reader& reader, const std::function<void(const Val& root)>& callback);
+    // Updates the values parsed by parse() after an edit: str is the new text, in which new_len bytes
+    // replaced the bytes [pos, pos + old_len) of the previous text. Only the smallest array or object
+    // enclosing the edit is parsed again, the values outside of it remain valid.
+    const Val& reparse(const char* str, size_t len, size_t pos, size_t old_len, size_t new_len);
+    void set_schema(const Schema* schema) noexcept { m_schema = schema; } // validate while parsing, nullptr to disable
+    void set_limits(const Limits& limits) noexcept { m_limits = limits; } // throw ErrLimit if exceeded while parsing
+    void set_threads(int32_t threads) noexcept { m_threads = threads; } // threads parsing a large root array of arrays or objects
+    const Val* get_root() const noexcept { return m_root; } // nullptr if nothing was parsed
+    size_t get_mem_usage() const noexcept; // approximate heap bytes used by the values and the text
     void clear() noexcept;
 private:
     void free_root() noexcept;
     void free_buf() noexcept;
+    bool reparse_container(const char* str, size_t len, size_t pos, size_t old_len, size_t new_len);
 private:
-    Val*  m_root = nullptr;
-    char* m_buf  = nullptr;
+    Val*          m_root   = nullptr;
+    char*         m_buf    = nullptr;
+    size_t        m_len    = 0;     // length of the text copied by parse(), 0 if parsed in place
+    std::vector<std::unique_ptr<char[]>> m_slices; // text parsed by reparse()
+    size_t        m_slices_len = 0;
+    const Schema* m_schema = nullptr;
+    Limits        m_limits;
+    int32_t       m_threads = 1;
+};
+
+void validate(const char* str, size_t len = 0, const Limits& limits = Limits()); // throws ErrSyntax as Json::parse() would, str must be zero-terminated if len=0
+// Removes the blanks, line breaks and // comments outside of the strings of a valid JSON, see validate().
+// out must have len + 1 bytes, it is zero-terminated. Returns the length of the output.
+size_t minify(const char* str, size_t len, char* out);
+size_t minify(char* str, size_t len = 0); // in place, str must have len + 1 bytes
+// Structural hash, cached in the arrays and objects: the members of an object are hashed in any
+// order, and the numbers by value, 1 and 1.0 have the same hash. Doesn't mark the values as accessed.
+uint64_t hash_val(const Val& v) noexcept;
+bool equals(const Val& a, const Val& b) noexcept; // same values, the members of the objects in any order
+std::string diff(const Val& from, const Val& to); // RFC 6902 JSON patch transforming 'from' into 'to'
+
+SimdLevel get_simd_level() noexcept; // the best level supported by the CPU, unless overridden by UJSON_SIMD environment variable or set_simd_level()
+SimdLevel set_simd_level(SimdLevel level) noexcept; // returns the level set, lowered to the best one supported by the CPU
+
+class Schema
+{
+public:
+    Schema() noexcept = default;
+    Schema(const Schema&) = delete;
+    Schema(Schema&&) = delete;
+    ~Schema() noexcept { clear(); }
+    Schema& operator = (const Schema&) = delete;
+    Schema& operator = (Schema&&) = delete;
+    void compile(const char* str, size_t len = 0); // throws ErrSyntax or ErrValue if the schema is invalid
+    void clear() noexcept;
+private:
+    friend class Json;
+    SchemaImpl* m_impl = nullptr;
 };
 
 class Val
 {
 public:
-    ValType get_type() const noexcept;
-    int32_t get_idx() const noexcept;
-    const char* get_name() const noexcept;
-    int32_t get_line() const;
-    bool is_num() const noexcept;
+    ValType get_type() const noexcept { return static_cast<ValType>(m_type & ~vtFlagBits); }
+    int32_t get_idx() const noexcept { return m_idx; }
+    const char* get_name() const noexcept { return m_name; }
+    int32_t get_line() const { return m_line_no; }
+    bool is_num() const noexcept { return (m_type & (vtInt | vtF64)) != 0; }
     const Bool& as_bool() const;
     const Int& as_int() const;
     const F64& as_f64() const;
@@ -67,13 +150,31 @@ protected:
     Val() = default;
     Val(const Val&) = default;
     ~Val() = default;
+    template<class T> const T& cast(uint32_t types) const;
+    [[noreturn]] void raise_bad_type(ValType expected) const;
+protected:
+    // The node layout is in the header so that the accessors above can be inlined.
+    // It is managed by ValImpl in ujson.cpp.
+    struct List;
+    union {
+        bool        b;
+        int64_t     i64;
+        double      f64;
+        const char* str;
+        List*       list;
+    }                 m_data = {};      //  8 bytes
+    mutable uint32_t  m_type = vtNull;  //  4 bytes, mutable because we set vtUsedBit when we access the value
+    int32_t           m_line_no = 0;    //  4 bytes
+    const char*       m_name = "";      //  8 bytes
+    int32_t           m_idx = -1;       //  4 bytes
+    int32_t           m_len = 0;        //  4 bytes, number of elements of an array or object
 };
 
 class Bool: public Val
 {
 public:
     static constexpr ValType type() { return vtBool; }
-    bool get() const noexcept;
+    bool get() const noexcept { return m_data.b; }
 protected:
     Bool() = default;
     Bool(const Bool&) = delete;
@@ -84,7 +185,7 @@ class Int: public Val
 {
 public:
     static constexpr ValType type() { return vtInt; }
-    int64_t get() const noexcept;
+    int64_t get() const noexcept { return m_data.i64; }
     int64_t get(int64_t lo, int64_t hi) const;
     int32_t get_i32() const; // checks if it fits in int32_t
     int32_t get_i32(int32_t lo, int32_t hi) const;
@@ -98,7 +199,7 @@ class F64: public Val
 {
 public:
     static constexpr ValType type() { return vtF64; }
-    double get() const noexcept;
+    double get() const noexcept { return (m_type & vtInt) ? static_cast<double>(m_data.i64) : m_data.f64; }
     double get(double lo, double hi) const;
 protected:
     F64() = default;
@@ -110,7 +211,7 @@ class Str: public Val
 {
 public:
     static constexpr ValType type() { return vtStr; }
-    const char* get() const noexcept;
+    const char* get() const noexcept { return m_data.str; }
     int32_t get_enum_idx(const char* const str_set[], size_t len) const;
     template <typename T, size_t N>
     T get_enum(
@@ -125,12 +226,47 @@ protected:
     ~Str() = default;
 };
 
+class ValSpan // contiguous child values of an array or object
+{
+public:
+    class Iter {
+    public:
+        const Val& operator * () const noexcept { return *m_val; }
+        const Val* operator -> () const noexcept { return m_val; }
+        Iter& operator ++ () noexcept { m_val = step(m_val, 1, m_stride); return *this; }
+        bool operator == (const Iter& other) const noexcept { return m_val == other.m_val; }
+        bool operator != (const Iter& other) const noexcept { return m_val != other.m_val; }
+    private:
+        friend class ValSpan;
+        Iter(const Val* val, size_t stride) noexcept : m_val{ val }, m_stride{ stride } {}
+        const Val* m_val;
+        size_t     m_stride;
+    };
+    Iter begin() const noexcept { return Iter(m_begin, m_stride); }
+    Iter end() const noexcept { return Iter(step(m_begin, m_len, m_stride), m_stride); }
+    int32_t size() const noexcept { return m_len; }
+    bool empty() const noexcept { return 0 == m_len; }
+    const Val& operator [] (int32_t idx) const noexcept { return *step(m_begin, idx, m_stride); }
+private:
+    friend class Arr;
+    // The values are stored by the implementation, 'stride' is the size of its value type.
+    static const Val* step(const Val* val, int32_t count, size_t stride) noexcept
+    {
+        return reinterpret_cast<const Val*>(reinterpret_cast<const char*>(val) + count * stride);
+    }
+    ValSpan(const Val* begin, int32_t len, size_t stride) noexcept : m_begin{ begin }, m_len{ len }, m_stride{ stride } {}
+    const Val* m_begin;
+    int32_t    m_len;
+    size_t     m_stride;
+};
+
 class Arr: public Val
 {
 public:
     static constexpr ValType type() { return vtArr; }
-    int32_t get_len() const noexcept;
-    const Val& get_element(int32_t idx) const;
+    int32_t get_len() const noexcept { return m_len; }
+    const Val& get_element(int32_t idx) const; // throws ErrMemberNotFound if idx is out of range
+    ValSpan get_elements() const; // marks all elements as accessed, for a packed array creates them
     bool get_bool(int32_t idx) const;
     int32_t get_i32(int32_t idx, int32_t lo = 0, int32_t hi = -1) const;
     int64_t get_i64(int32_t idx, int64_t lo = 0, int64_t hi = -1) const;
@@ -138,6 +274,12 @@ public:
     const char* get_str(int32_t idx) const;
     const Arr& get_arr(int32_t idx) const;
     const Obj& get_obj(int32_t idx) const;
+    const int64_t* get_i64_data() const noexcept; // nullptr unless the array is packed and all elements are integers
+    const double* get_f64_data() const noexcept;  // nullptr unless the array is packed and contains floats
+    int32_t copy_i64(int64_t* dst, int32_t len, int64_t lo = 0, int64_t hi = -1) const; // returns number of copied elements
+    int32_t copy_f64(double* dst, int32_t len, double lo = 0.0, double hi = -1.0) const;
+    void get_columns(Column* cols, size_t len, int32_t threads = 1) const; // elements must be objects
+    ArrIndex build_index(const char* name, bool required = true, int32_t threads = 1) const; // elements must be objects, see ArrIndex
 protected:
     Arr() = default;
     Arr(const Arr&) = delete;
@@ -147,10 +289,39 @@ protected:
 class Obj: public Arr
 {
 public:
+    struct Member {
+        const char* name;
+        const Val&  val;
+    };
+    class Members // iterates the (name, value) pairs
+    {
+    public:
+        class Iter {
+        public:
+            Member operator * () const noexcept { return { m_iter->get_name(), *m_iter }; }
+            Iter& operator ++ () noexcept { ++m_iter; return *this; }
+            bool operator == (const Iter& other) const noexcept { return m_iter == other.m_iter; }
+            bool operator != (const Iter& other) const noexcept { return m_iter != other.m_iter; }
+        private:
+            friend class Members;
+            explicit Iter(ValSpan::Iter iter) noexcept : m_iter{ iter } {}
+            ValSpan::Iter m_iter;
+        };
+        Iter begin() const noexcept { return Iter(m_vals.begin()); }
+        Iter end() const noexcept { return Iter(m_vals.end()); }
+        int32_t size() const noexcept { return m_vals.size(); }
+    private:
+        friend class Obj;
+        explicit Members(ValSpan vals) noexcept : m_vals{ vals } {}
+        ValSpan m_vals;
+    };
+
     static constexpr ValType type() { return vtObj; }
+    Members get_members() const; // marks all members as accessed
     int32_t get_member_idx(const char* name, bool required=true) const; // -1 if not found
     const char* get_member_name(int32_t idx) const;
     const Val* get_member(const char* name, bool required=true) const;
+    void get_many(const char* const names[], size_t len, const Val* vals[], bool required=true) const; // vals[i] is nullptr if not found, throws ErrMemberNotFound naming all required members not found
     bool get_bool(const char* name, const bool* def = nullptr) const;
     bool get_bool(const char* name, bool def) const { return get_bool(name, &def); }
     int32_t get_i32(const char* name, int32_t lo = 0,  int32_t hi = -1, const int32_t* def = nullptr) const;
@@ -187,6 +358,275 @@ protected:
     ~Obj() = default;
 };
 
+template<class T>
+inline const T& Val::cast(uint32_t types) const
+{
+    if (0 == (m_type & types)) {
+        raise_bad_type(T::type());
+    }
+    return *static_cast<const T*>(this);
+}
+
+inline const Bool& Val::as_bool() const { return cast<Bool>(vtBool); }
+inline const Int&  Val::as_int()  const { return cast<Int>(vtInt); }
+inline const F64&  Val::as_f64()  const { return cast<F64>(vtInt | vtF64); }
+inline const Str&  Val::as_str()  const { return cast<Str>(vtStr); }
+inline const Arr&  Val::as_arr()  const { return cast<Arr>(vtArr); }
+inline const Obj&  Val::as_obj()  const { return cast<Obj>(vtObj); }
+
+struct Column // a member fetched from all objects of an array by Arr::get_columns()
+{
+    const char* name     = "";
+    ValType     type     = vtNone; // vtBool, vtInt, vtF64 or vtStr
+    bool        required = true;   // if false, the default is used when the member is absent
+    int64_t     def_i64  = 0;      // default for vtBool and vtInt
+    double      def_f64  = 0.0;    // default for vtF64
+    const char* def_str  = "";     // default for vtStr
+
+    std::vector<int64_t>     i64;   // vtBool and vtInt values
+    std::vector<double>      f64;   // vtF64 values
+    std::vector<int32_t>     codes; // vtStr values, as indexes in 'dict'
+    std::vector<const char*> dict;  // vtStr distinct values, in the order of first occurrence
+};
+
+// The elements of an array of objects by the value of a member, all strings or all integers,
+// built by Arr::build_index(). If several elements have the same key, the first one is found.
+// Immutable, so it can be shared by threads, valid while the array is.
+class ArrIndex
+{
+public:
+    ArrIndex() = default;
+    const char* get_name() const noexcept { return m_name.c_str(); }
+    ValType get_key_type() const noexcept { return m_key_type; } // vtStr, vtInt, or vtNone if no key
+    int32_t get_len() const noexcept { return m_len; }           // number of distinct keys
+    int32_t find_str(const char* key) const noexcept; // element index, -1 if not found
+    int32_t find_i64(int64_t key) const noexcept;
+private:
+    friend class Arr;
+    struct Slot {
+        uint32_t   hash;
+        int32_t    idx; // element index, -1 if the slot is empty
+        const Val* key;
+    };
+    const Slot* find_slot(uint32_t hash, ValType type, const char* str, int64_t i64) const noexcept;
+    std::string       m_name;
+    ValType           m_key_type = vtNone;
+    int32_t           m_len = 0;
+    std::vector<Slot> m_slots; // size is 0 or a power of 2, at least twice the number of keys
+};
+
+class Path // a path to a nested value like "servers[3].tls.port", compiled once to be evaluated in many documents
+{
+public:
+    Path() = default;
+    explicit Path(const char* path) { compile(path); }
+    void compile(const char* path); // throws Err if the syntax is invalid, "" is the root value
+    const Val* eval(const Val& root, bool required = true) const; // throws ErrMemberNotFound or ErrBadType if required
+    bool get_bool(const Val& root) const;
+    int32_t get_i32(const Val& root, int32_t lo = 0, int32_t hi = -1) const;
+    int64_t get_i64(const Val& root, int64_t lo = 0, int64_t hi = -1) const;
+    double get_f64(const Val& root, double lo = 0.0, double hi = -1.0) const;
+    const char* get_str(const Val& root) const;
+    const Arr& get_arr(const Val& root) const;
+    const Obj& get_obj(const Val& root) const;
+private:
+    struct Step {
+        std::string name; // member name, or empty for an array element
+        uint32_t    hash = 0;
+        int32_t     idx  = -1;
+    };
+    std::vector<Step> m_steps;
+};
+
+class RecordViewBase // see RecordView
+{
+protected:
+    RecordViewBase() = default;
+    // Resolves the names in the object, reusing 'idx' if it has the layout of the previous object,
+    // and sets 'vals' to the members found or nullptr.
+    void bind(const Obj& obj, const char* const names[], int32_t idx[], const Val* vals[], size_t len, bool required);
+    [[noreturn]] void raise_not_found(const char* name) const;
+protected:
+    const Obj* m_obj = nullptr;
+    int32_t    m_count = -1;      // number of members of the previous object
+    uint64_t   m_shape = 0;       // hash of the member names of the previous object
+};
+
+// A fixed set of member names, bound to one object at a time, like the objects of an array of
+// records. The member indexes are resolved by bind() and reused for the next objects with the same
+// layout, after comparing the names at these indexes and looking up the names not found again, then
+// the values are fetched by their slot in 'names', without any lookup.
+template <size_t N>
+class RecordView : public RecordViewBase
+{
+public:
+    explicit RecordView(const std::array<const char*, N>& names) noexcept : m_names{ names } { m_idx.fill(-1); m_vals.fill(nullptr); }
+    const RecordView& bind(const Obj& obj, bool required = true) // throws ErrMemberNotFound naming all required members not found
+    {
+        RecordViewBase::bind(obj, m_names.data(), m_idx.data(), m_vals.data(), N, required);
+        return *this;
+    }
+    const Val* get(size_t slot) const noexcept { return m_vals[slot]; }
+    const Val& get_val(size_t slot) const
+    {
+        if (nullptr == m_vals[slot]) raise_not_found(m_names[slot]);
+        return *m_vals[slot];
+    }
+    bool get_bool(size_t slot) const { return get_val(slot).as_bool().get(); }
+    int32_t get_i32(size_t slot, int32_t lo = 0, int32_t hi = -1) const { return get_val(slot).as_int().get_i32(lo, hi); }
+    int64_t get_i64(size_t slot, int64_t lo = 0, int64_t hi = -1) const { return get_val(slot).as_int().get(lo, hi); }
+    double get_f64(size_t slot, double lo = 0.0, double hi = -1.0) const { return get_val(slot).as_f64().get(lo, hi); }
+    const char* get_str(size_t slot) const { return get_val(slot).as_str().get(); }
+    const Arr& get_arr(size_t slot) const { return get_val(slot).as_arr(); }
+    const Obj& get_obj(size_t slot) const { return get_val(slot).as_obj(); }
+private:
+    std::array<const char*, N> m_names;
+    std::array<int32_t, N>     m_idx; // -1 if not found
+    std::array<const Val*, N>  m_vals; // members of m_obj, nullptr if not found
+};
+
+// A member name looked up in many objects, usually of the same layout like the documents of a
+// NDJSON stream, declared at the call site: static thread_local MemberCache user("user");
+// The index found is reused while the objects have the layout of the previous one.
+class MemberCache
+{
+public:
+    explicit MemberCache(const char* name) noexcept : m_name{ name } {}
+    const char* get_name() const noexcept { return m_name; }
+    const Val* get_member(const Obj& obj, bool required = true); // throws ErrMemberNotFound if required and not found
+    bool get_bool(const Obj& obj, const bool* def = nullptr)
+    {
+        auto* v = get_member(obj, nullptr == def);
+        return v ? v->as_bool().get() : *def;
+    }
+    bool get_bool(const Obj& obj, bool def) { return get_bool(obj, &def); }
+    int32_t get_i32(const Obj& obj, int32_t lo = 0, int32_t hi = -1, const int32_t* def = nullptr)
+    {
+        auto* v = get_member(obj, nullptr == def);
+        return v ? v->as_int().get_i32(lo, hi) : *def;
+    }
+    int32_t get_i32(const Obj& obj, int32_t lo, int32_t hi, int32_t def) { return get_i32(obj, lo, hi, &def); }
+    int64_t get_i64(const Obj& obj, int64_t lo = 0, int64_t hi = -1, const int64_t* def = nullptr)
+    {
+        auto* v = get_member(obj, nullptr == def);
+        return v ? v->as_int().get(lo, hi) : *def;
+    }
+    int64_t get_i64(const Obj& obj, int64_t lo, int64_t hi, int64_t def) { return get_i64(obj, lo, hi, &def); }
+    double get_f64(const Obj& obj, double lo = 0.0, double hi = -1.0, const double* def = nullptr)
+    {
+        auto* v = get_member(obj, nullptr == def);
+        return v ? v->as_f64().get(lo, hi) : *def;
+    }
+    double get_f64(const Obj& obj, double lo, double hi, double def) { return get_f64(obj, lo, hi, &def); }
+    const char* get_str(const Obj& obj, const char* def = nullptr)
+    {
+        auto* v = get_member(obj, nullptr == def);
+        return v ? v->as_str().get() : def;
+    }
+    const Arr& get_arr(const Obj& obj) { return get_member(obj)->as_arr(); }
+    const Obj& get_obj(const Obj& obj) { return get_member(obj)->as_obj(); }
+private:
+    const char* m_name;
+    uint64_t    m_shape = 0;  // hash of the member names of the previous object
+    int32_t     m_count = -1; // number of members of the previous object
+    int32_t     m_idx = -1;   // -1 if not found in the previous object
+};
+
+class LiveDoc // a JSON file reloaded in a background thread when it changes
+{
+public:
+    using Validate = std::function<void(const Val& root)>; // throws to reject a new content
+
+    class Snapshot // keeps a version of the document allocated, must not outlive LiveDoc
+    {
+    public:
+        Snapshot(Snapshot&& other) noexcept : m_root{ other.m_root }, m_readers{ other.m_readers } { other.m_readers = nullptr; }
+        Snapshot(const Snapshot&) = delete;
+        ~Snapshot() noexcept { if (m_readers) m_readers->fetch_sub(1); }
+        Snapshot& operator = (const Snapshot&) = delete;
+        Snapshot& operator = (Snapshot&&) = delete;
+        const Val& get_root() const noexcept { return *m_root; }
+    private:
+        friend class LiveDoc;
+        Snapshot(const Val* root, std::atomic<int32_t>* readers) noexcept : m_root{ root }, m_readers{ readers } {}
+        const Val*            m_root;
+        std::atomic<int32_t>* m_readers;
+    };
+
+    explicit LiveDoc(const char* path, Validate validate = nullptr, int32_t poll_ms = 500); // throws if the first load fails
+    LiveDoc(const LiveDoc&) = delete;
+    LiveDoc(LiveDoc&&) = delete;
+    ~LiveDoc() noexcept;
+    LiveDoc& operator = (const LiveDoc&) = delete;
+    LiveDoc& operator = (LiveDoc&&) = delete;
+    Snapshot get() const noexcept; // lock-free
+    bool reload(); // returns false if the new content is rejected, see get_last_err()
+    std::string get_last_err() const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+class DocCache // thread-safe cache of parsed documents, keyed by their content
+{
+public:
+    struct Stats {
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t evictions = 0;
+        size_t   bytes     = 0; // memory used by the cached documents, see Json::get_mem_usage()
+        size_t   docs      = 0;
+    };
+
+    explicit DocCache(size_t max_bytes);
+    DocCache(const DocCache&) = delete;
+    DocCache(DocCache&&) = delete;
+    ~DocCache() noexcept;
+    DocCache& operator = (const DocCache&) = delete;
+    DocCache& operator = (DocCache&&) = delete;
+    std::shared_ptr<const Json> parse(const char* str, size_t len = 0); // throws as Json::parse(), str must be zero-terminated if len=0
+    Stats get_stats() const;
+    void clear() noexcept;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+#if defined(UJSON_ZLIB)
+class GzipReader // a Reader of a gzip file, decompressed by a background thread into two alternating blocks
+{
+public:
+    explicit GzipReader(const char* path, size_t block_size = 1 << 20); // throws Err if the file can't be opened
+    size_t operator () (char* buf, size_t size) const; // throws Err if the file is corrupted
+private:
+    struct Impl;
+    std::shared_ptr<Impl> m_impl; // shared by the copies, the thread stops when the last one is destroyed
+};
+#endif
+
+class BatchLoader // loads and parses many files, reading ahead while other threads parse
+{
+public:
+    struct Stats {
+        size_t   files   = 0;
+        size_t   errors  = 0;
+        uint64_t bytes   = 0;
+        double   seconds = 0.0;
+        double get_files_per_sec() const noexcept { return (seconds > 0.0) ? files / seconds : 0.0; }
+        double get_mb_per_sec() const noexcept { return (seconds > 0.0) ? bytes / seconds / 1e6 : 0.0; }
+    };
+    // Called by the parsing threads concurrently, with either the root value or the error.
+    // The values are released when it returns.
+    using Callback = std::function<void(size_t idx, const char* path, const Val* root, const Err* err)>;
+
+    explicit BatchLoader(int32_t readers = 4, int32_t parsers = 0, size_t max_bytes = 256 << 20); // parsers=0 for one per core
+    Stats load(const std::vector<std::string>& paths, const Callback& callback) const; // rethrows an exception of the callback
+private:
+    int32_t m_readers;
+    int32_t m_parsers;
+    size_t  m_max_bytes; // files read and not yet parsed, a larger file is read when nothing else is
+};
+
 struct Err : std::runtime_error {
     int32_t line;
 
@@ -199,7 +639,12 @@ struct ErrSyntax : Err // errors that occur during parsing due to invalid JSON s
     explicit ErrSyntax(const char* msg, int32_t line_no) noexcept : Err(msg, line_no) {}
 };
 
-struct ErrValue : Err // errors that occur when value validation fails (after it was successfully parsed)
+struct ErrLimit : ErrSyntax // a value of Limits was exceeded
+{
+    explicit ErrLimit(const char* msg, int32_t line_no) noexcept : ErrSyntax(msg, line_no) {}
+};
+
+struct ErrValue : Err // errors that occur when value validation fails (after it was successfully parsed, or by Schema)
 {
     std::string val_name;
     int32_t     val_idx;
@@ -235,9 +680,19 @@ struct ErrBadF64Range : ErrValue
     std::string get_err_str() const override;
 };
 
+struct ErrBadLen : ErrValue
+{
+    int32_t lo;
+    int32_t hi;
+
+    explicit ErrBadLen(const Val& v, int32_t lo, int32_t hi) noexcept;
+    std::string get_err_str() const override;
+};
+
 struct ErrMemberNotFound : ErrValue
 {
     explicit ErrMemberNotFound(const Obj& v, const char* name) noexcept;
+    explicit ErrMemberNotFound(const Arr& v, int32_t idx) noexcept; // element index out of range
 };
 
 struct ErrUnknownMember : ErrValue
@@ -250,4 +705,303 @@ struct ErrBadEnum : ErrValue
     explicit ErrBadEnum(const Val& v) noexcept;
 };
 
+// Checks the syntax as validate() does, in a constant expression. A syntax error makes it not constant,
+// so the compiler reports the throw of ErrSyntax with its message. Unlike validate(), the range of the
+// floats isn't checked, and the member names are compared as written to find the duplicates.
+template <size_t N> // size of the literal, ending 0 included
+class ConstValidator
+{
+public:
+    constexpr explicit ConstValidator(const char (&str)[N]) noexcept : m_next{ str }, m_end{ str + N - 1 } {}
+
+    constexpr size_t validate() // returns the length
+    {
+        const char* begin = m_next;
+        validate_val();
+        skip_white_space();
+        check(m_next == m_end, "invalid value syntax");
+        return static_cast<size_t>(m_end - begin);
+    }
+
+private:
+    struct Name {
+        const char* begin = nullptr; // nullptr if the slot is free
+        const char* end = nullptr;
+        uint32_t    hash = 0;
+        uint32_t    obj = 0;
+    };
+
+    static constexpr size_t table_size(size_t count) noexcept // a power of 2, at least twice 'count'
+    {
+        size_t size = 1;
+        while (size < 2 * count) size *= 2;
+        return size;
+    }
+
+    static constexpr size_t name_slots = table_size(N / 4 + 1); // a member takes at least 4 bytes: "":0
+
+    constexpr void check(bool ok, const char* msg) const
+    {
+        if (!ok) throw ErrSyntax(msg, m_line_count);
+    }
+
+    constexpr char peek(size_t i = 0) const noexcept
+    {
+        return (m_next + i < m_end) ? m_next[i] : 0;
+    }
+
+    constexpr bool skip_text(const char* str) noexcept
+    {
+        size_t len = 0;
+        for (; str[len]; len++) {
+            if (peek(len) != str[len]) return false;
+        }
+        m_next += len;
+        return true;
+    }
+
+    constexpr void skip_white_space() noexcept
+    {
+        while (true) {
+            const char c = peek();
+            if (' ' == c || '\t' == c) {
+                m_next++;
+            }
+            else if ('\r' == c || '\n' == c || ('/' == c && '/' == peek(1))) {
+                skip_to_eol();
+            }
+            else {
+                break;
+            }
+        }
+    }
+
+    constexpr void skip_to_eol() noexcept
+    {
+        while (m_next < m_end) {
+            const char c = *m_next++;
+            if ('\r' == c) {
+                m_line_count++;
+                if ('\n' == peek()) m_next++;
+                break;
+            }
+            if ('\n' == c) {
+                m_line_count++;
+                break;
+            }
+        }
+    }
+
+    constexpr void validate_val()
+    {
+        skip_white_space();
+        switch (peek()) { // by the first byte, as each attempt costs in a constant expression
+        case 'n': if (skip_text("null")) return; break;
+        case 'f': if (skip_text("false")) return; break;
+        case 't': if (skip_text("true")) return; break;
+        case '"': if (scan_str()) return; break;
+        case '[': if (validate_arr()) return; break;
+        case '{': if (validate_obj()) return; break;
+        default:  if (scan_num()) return; break;
+        }
+        check(false, "invalid syntax");
+    }
+
+    constexpr bool validate_arr()
+    {
+        if (!skip_text("[")) return false;
+        while (true) {
+            skip_white_space();
+            if (skip_text("]")) break;
+            validate_val();
+            skip_white_space();
+            if (skip_text("]")) break;
+            check(skip_text(","), "invalid array syntax: expected ',' or ']'");
+        }
+        return true;
+    }
+
+    // The member names are kept as [begin, end) ranges, quotes included, in a hash table of all the
+    // objects, so that each name is compared only to the names of its object with the same hash.
+    constexpr bool validate_obj()
+    {
+        if (!skip_text("{")) return false;
+        const uint32_t obj = ++m_obj_count;
+        while (true) {
+            skip_white_space();
+            if (skip_text("}")) break;
+            const char* name = m_next;
+            check(scan_str(), "invalid object syntax: expected member name or '}'");
+            check(add_name(obj, name, m_next), "invalid object syntax: duplicate member name");
+            skip_white_space();
+            check(skip_text(":"), "invalid object syntax: expected ':' after member name");
+            validate_val();
+            skip_white_space();
+            if (skip_text("}")) break;
+            check(skip_text(","), "invalid object syntax: expected ',' or '}'");
+        }
+        return true;
+    }
+
+    constexpr bool add_name(uint32_t obj, const char* name, const char* name_end) // false if the object has it
+    {
+        uint32_t hash = 2166136261u ^ (obj * 2654435761u); // FNV-1a, seeded by the object
+        for (const char* p = name; p < name_end; p++) {
+            hash = (hash ^ static_cast<unsigned char>(*p)) * 16777619u;
+        }
+        const size_t mask = name_slots - 1;
+        size_t i = hash & mask;
+        for (; nullptr != m_names[i].begin; i = (i + 1) & mask) {
+            const Name& other = m_names[i];
+            if (other.hash == hash && other.obj == obj && same_str(other.begin, other.end, name, name_end)) return false;
+        }
+        m_names[i] = { name, name_end, hash, obj };
+        return true;
+    }
+
+    static constexpr bool same_str(const char* str, const char* end, const char* other, const char* other_end) noexcept
+    {
+        if (end - str != other_end - other) return false;
+        for (; str < end; str++, other++) {
+            if (*str != *other) return false;
+        }
+        return true;
+    }
+
+    constexpr bool is_digit(size_t i) const noexcept
+    {
+        return peek(i) >= '0' && peek(i) <= '9';
+    }
+
+    constexpr bool scan_num()
+    {
+        size_t i = ('-' == peek()) ? 1 : 0;
+        const size_t num_start = i;
+        if (!is_digit(i)) {
+            check(0 == i, "invalid number syntax: no digits after '-'");
+            return false;
+        }
+        int64_t n = 0; // negative as in Parser::scan_num()
+        const int64_t a = -922337203685477580;
+        const int b = (1 == num_start) ? 8 : 7;
+        bool too_big = false;
+        for (char c = peek(i); c >= '0' && c <= '9'; c = peek(++i)) {
+            const int digit = c - '0';
+            too_big = too_big || n < a || (n == a && digit > b);
+            n = too_big ? n : n * 10 - digit;
+        }
+        check('0' != peek(num_start) || 1 == i - num_start,
+            "invalid number syntax: can't start with '0' if followed by another digit");
+        bool is_float = false;
+        if ('.' == peek(i)) {
+            is_float = true;
+            for (i++; is_digit(i); i++) {}
+        }
+        if ('E' == peek(i) || 'e' == peek(i)) {
+            is_float = true;
+            i += ('+' == peek(i + 1) || '-' == peek(i + 1)) ? 2 : 1;
+            check(is_digit(i), "invalid number syntax: bad float format");
+            for (; is_digit(i); i++) {}
+        }
+        check(is_float || !too_big, "invalid number syntax: integer doesn't fit in 64 bits");
+        m_next += i;
+        return true;
+    }
+
+    constexpr bool scan_str()
+    {
+        if (!skip_text("\"")) return false;
+        while (true) {
+            const char c = peek();
+            if (static_cast<unsigned char>(c) >= ' ' && '\\' != c) { // most of the bytes
+                m_next++;
+                if ('"' == c) break;
+                continue;
+            }
+            check(m_next < m_end && '\r' != c && '\n' != c,
+                "invalid string syntax: line ending before closing quotes");
+            check(static_cast<unsigned char>(c) >= ' ', "invalid string syntax: control characters not allowed");
+            m_next++;
+            if ('\\' == c) {
+                const char e = peek();
+                m_next++;
+                if ('u' == e) {
+                    scan_encoding();
+                }
+                else {
+                    check('"' == e || '\\' == e || '/' == e || 'b' == e || 'f' == e || 'n' == e || 'r' == e || 't' == e,
+                        "invalid string syntax: bad escape character");
+                }
+            }
+        }
+        return true;
+    }
+
+    constexpr void scan_encoding()
+    {
+        const uint32_t code = scan_hex4();
+        check(code < 0xDC00 || code > 0xDFFF, "invalid string syntax: bad utf-16 codepoint");
+        if (code >= 0xD800 && code <= 0xDBFF) {
+            check(skip_text("\\u"), "invalid string syntax: bad utf-16 codepoint");
+            const uint32_t code2 = scan_hex4();
+            check(code2 >= 0xDC00 && code2 <= 0xDFFF, "invalid string syntax: bad utf-16 codepoint");
+        }
+    }
+
+    constexpr uint32_t scan_hex4()
+    {
+        uint32_t code = 0;
+        for (int i = 0; i < 4; i++) {
+            const char c = peek();
+            code <<= 4;
+            if (c >= '0' && c <= '9') {
+                code += c - '0';
+            }
+            else if (c >= 'A' && c <= 'F') {
+                code += c - 'A' + 10;
+            }
+            else if (c >= 'a' && c <= 'f') {
+                code += c - 'a' + 10;
+            }
+            else {
+                check(false, "invalid string syntax: bad utf-16 codepoint");
+            }
+            m_next++;
+        }
+        return code;
+    }
+
+private:
+    const char* m_next;
+    const char* m_end;
+    int32_t     m_line_count = 1;
+    Name        m_names[name_slots] = {};
+    uint32_t    m_obj_count = 0;
+};
+
+class JsonLiteral // a JSON string literal, whose syntax is checked at compile time when declared constexpr
+{
+public:
+    template <size_t N>
+    constexpr JsonLiteral(const char (&str)[N]) : m_str{ str }, m_len{ ConstValidator<N>(str).validate() } {}
+    constexpr const char* c_str() const noexcept { return m_str; }
+    constexpr size_t size() const noexcept { return m_len; }
+private:
+    const char* m_str;
+    size_t      m_len;
+};
+
+class StaticDoc // a JsonLiteral parsed once at the first access, by any thread, kept until exit
+{
+public:
+    explicit constexpr StaticDoc(const JsonLiteral& literal) noexcept : m_literal{ literal } {}
+    StaticDoc(const StaticDoc&) = delete;
+    StaticDoc& operator = (const StaticDoc&) = delete;
+    const Val& get_root() const; // throws ErrSyntax for a float out of range, not checked at compile time
+private:
+    JsonLiteral                   m_literal;
+    mutable std::once_flag        m_once;
+    mutable std::unique_ptr<Json> m_json;
+};
+
 }; // namespace ujson